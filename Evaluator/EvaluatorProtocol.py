@@ -0,0 +1,48 @@
+# Framing shared by the evaluator worker and the game, over the worker's stdin/stdout pipes.
+#
+# Every message is: b"SAEV", payload length as a little endian uint32, payload.
+# Requests carry one Quick, Draw! ndjson line, responses a JSON object:
+#   {"class": "<predicted class>", "scores": [...]} or {"error": "<message>"}
+# The game skips anything written between frames, so stray prints cannot break the stream.
+
+import struct
+import sys
+
+MAGIC = b"SAEV"
+HEADER = struct.Struct("<4sI")
+
+
+def read_exactly(stream, size):
+    data = b""
+    while len(data) < size:
+        chunk = stream.read(size - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+
+def read_frame(stream):
+    """Returns the next payload, or None once the game closed the pipe."""
+    header = read_exactly(stream, HEADER.size)
+    if header is None:
+        return None
+
+    magic, length = HEADER.unpack(header)
+    if magic != MAGIC:
+        raise ValueError("Unexpected frame header: {}".format(header))
+
+    return read_exactly(stream, length)
+
+
+def write_frame(stream, payload):
+    stream.write(HEADER.pack(MAGIC, len(payload)))
+    stream.write(payload)
+    stream.flush()
+
+
+def take_stdout():
+    """Returns the binary stdout for frames, and sends every print to stderr instead."""
+    out = sys.stdout.buffer
+    sys.stdout = sys.stderr
+    return sys.stdin.buffer, out
@@ -0,0 +1,164 @@
+# Exports a trained QuickDrawRNN for the native evaluator in the game (Source/SpeedArtist/Public/Evaluation/QuickDrawModel.h).
+#
+# Weights file, all little endian:
+#   uint32 magic "SAQW", uint32 version (2), uint32 tensor count
+#   per tensor: uint32 name length, name (the state dict key), uint32 data type, uint32 dim count, uint32 dims..., data
+#   data type 0: float32 values, 1: float16 values, 2: float32 scale per row (first dim), then int8 values
+#
+# Only the LSTM matrices are quantized, into <root>.fp16.weights and <root>.int8.weights. The rest stays float32.
+#
+# The parity file is the sample ndjson with a "logits" field added to every line, as computed by PyTorch.
+# The game checks its own forward pass against it with the SpeedArtist.Model.Parity console command.
+
+import argparse
+import copy
+import json
+import os
+import struct
+
+import torch
+
+from PaintingRater import QuickDrawRNN, get_classes, parseLine
+
+WEIGHTS_MAGIC = 0x57514153  # "SAQW"
+WEIGHTS_VERSION = 2
+
+FLOAT32, FLOAT16, INT8 = 0, 1, 2
+SUFFIXES = {"fp32": ".weights", "fp16": ".fp16.weights", "int8": ".int8.weights"}
+
+
+def is_quantized(name):
+    return name.startswith("lstm.weight_")
+
+
+def quantize_int8(tensor):
+    """Symmetric int8 with one scale per row, so the game can apply it once per gate output."""
+    scales = tensor.abs().amax(dim=1) / 127
+    scales[scales == 0] = 1
+    values = torch.round(tensor / scales[:, None]).clamp(-127, 127).to(torch.int8)
+    return values, scales
+
+
+def dequantize(state_dict, precision):
+    """The weights the game ends up multiplying with, for the PyTorch side of the report."""
+    result = copy.deepcopy(state_dict)
+    for name, tensor in result.items():
+        if not is_quantized(name) or precision == "fp32":
+            continue
+
+        if precision == "fp16":
+            result[name] = tensor.half().float()
+        else:
+            values, scales = quantize_int8(tensor)
+            result[name] = values.float() * scales[:, None]
+
+    return result
+
+
+def export_weights(state_dict, path, precision):
+    with open(path, "wb") as file:
+        file.write(struct.pack("<III", WEIGHTS_MAGIC, WEIGHTS_VERSION, len(state_dict)))
+        for name, tensor in state_dict.items():
+            tensor = tensor.detach().cpu().float().contiguous()
+            data_type = FLOAT32
+            if is_quantized(name) and precision == "fp16":
+                data_type = FLOAT16
+            elif is_quantized(name) and precision == "int8":
+                data_type = INT8
+
+            encoded_name = name.encode("utf-8")
+            file.write(struct.pack("<I", len(encoded_name)))
+            file.write(encoded_name)
+            file.write(struct.pack("<II", data_type, tensor.dim()))
+            file.write(struct.pack("<{}I".format(tensor.dim()), *tensor.shape))
+
+            if data_type == FLOAT32:
+                file.write(tensor.numpy().astype("<f4").tobytes())
+            elif data_type == FLOAT16:
+                file.write(tensor.numpy().astype("<f2").tobytes())
+            else:
+                values, scales = quantize_int8(tensor)
+                file.write(scales.numpy().astype("<f4").tobytes())
+                file.write(values.numpy().tobytes())
+
+
+def export_parity(qd_model, ndjson_path, path):
+    with open(ndjson_path) as file, open(path, "w") as out:
+        for line in file:
+            if not line.strip():
+                continue
+
+            ink, _ = parseLine(line)
+            if ink.shape[0] == 0:
+                continue
+
+            with torch.no_grad():
+                logits = qd_model(ink.unsqueeze(0), torch.tensor([ink.shape[0]]))
+
+            sample = json.loads(line)
+            sample["logits"] = logits[0].tolist()
+            out.write(json.dumps(sample, separators=(",", ":")) + "\n")
+
+
+def report(qd_model, classes, precisions, ndjson_path):
+    """Accuracy of every exported precision on held-out drawings, and how often it agrees with float32."""
+    drawings = []
+    with open(ndjson_path) as file:
+        for line in file:
+            if not line.strip():
+                continue
+
+            ink, class_name = parseLine(line)
+            if ink.shape[0] > 0:
+                drawings.append((ink, class_name))
+
+    if not drawings:
+        print("No drawings in", ndjson_path)
+        return
+
+    def predict(model):
+        with torch.no_grad():
+            return [torch.argmax(model(ink.unsqueeze(0), torch.tensor([ink.shape[0]])), dim=1)[0].item() for ink, _ in drawings]
+
+    baseline = predict(qd_model)
+    for precision in precisions:
+        variant = QuickDrawRNN(classes)
+        variant.load_state_dict(dequantize(qd_model.state_dict(), precision))
+        variant.eval()
+
+        predictions = predict(variant)
+        correct = sum(classes[p] == class_name for p, (_, class_name) in zip(predictions, drawings))
+        agreeing = sum(p == b for p, b in zip(predictions, baseline))
+        print("{}: accuracy {:.2f}%, agrees with fp32 on {:.2f}% of {} drawings".format(
+            precision, 100 * correct / len(drawings), 100 * agreeing / len(drawings), len(drawings)))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("model_root_path", type=str, nargs="?", default="models/model_20250411_222609_1",
+                        help="The state dict, with the class list next to it as <path>_classes")
+    parser.add_argument("--parity-input", type=str, default="../Content/PaintingHistory/Painting_0.ndjson",
+                        help="Drawings to compute reference logits for")
+    parser.add_argument("--precision", type=str, nargs="+", choices=list(SUFFIXES), default=["fp32"],
+                        help="Weight files to write, fp16 and int8 only shrink the LSTM matrices")
+    parser.add_argument("--held-out", type=str,
+                        help="Ndjson drawings to report the accuracy of every exported precision on")
+    args = parser.parse_args()
+
+    torch.set_default_device("cpu")
+
+    classes, _ = get_classes(args.model_root_path + "_classes")
+    qd_model = QuickDrawRNN(classes)
+    qd_model.load_state_dict(torch.load(args.model_root_path, weights_only=True, map_location="cpu"))
+    qd_model.eval()
+
+    for precision in args.precision:
+        path = args.model_root_path + SUFFIXES[precision]
+        export_weights(qd_model.state_dict(), path, precision)
+        print("Exported", path, "({:.2f} MB)".format(os.path.getsize(path) / (1024 * 1024)))
+
+    export_parity(qd_model, args.parity_input, args.model_root_path + "_parity.ndjson")
+    print("Exported", args.model_root_path + "_parity.ndjson")
+
+    if args.held_out:
+        report(qd_model, classes, args.precision, args.held_out)
@@ -12,6 +12,9 @@ import sklearn as sks
 from os import listdir
 from os.path import isfile, join
 import argparse
+import sys
+
+from EvaluatorProtocol import read_frame, write_frame, take_stdout
 
 
 # CONSTANTS
@@ -222,7 +225,48 @@ def readData(filePath, classToIndex):
 
     return samples
 
+def serve(qd_model, classes):
+    """Keeps the model loaded and answers framed requests until the game closes stdin."""
+    requests_in, responses_out = take_stdout()
+    print("Evaluator ready")
+
+    qd_model.train(False)
+    while True:
+        payload = read_frame(requests_in)
+        if payload is None:
+            break
+
+        try:
+            ink, _ = parseLine(payload.decode("utf-8"))
+            if ink.shape[0] == 0:
+                response = {"class": "Empty", "scores": []}
+            else:
+                with torch.no_grad():
+                    logits = qd_model(ink.unsqueeze(0).to(torch.get_default_device()), torch.tensor([ink.shape[0]]))
+
+                predicted_label = torch.argmax(logits, dim=1)[0].item()
+                response = {"class": classes[predicted_label], "scores": logits[0].tolist()}
+        except Exception as e:
+            response = {"error": str(e)}
+
+        write_frame(responses_out, json.dumps(response).encode("utf-8"))
+
 if __name__ == "__main__":
+    # Parse the arguments
+    parser = argparse.ArgumentParser()
+    parser.add_argument('input_file_path', type=str, nargs='?',
+                        help='The path to the input ndjson file')
+    parser.add_argument('--server', action='store_true',
+                        help='Stay alive and evaluate the drawings sent over stdin (see EvaluatorProtocol.py)')
+
+    args = parser.parse_args()
+    if not args.server and args.input_file_path is None:
+        parser.error("the input file path is required unless --server is given")
+
+    # In server mode stdout carries the protocol, everything else goes to stderr
+    if args.server:
+        sys.stdout = sys.stderr
+
     # Use the GPU instead of the CPU for PyTorch
     set_cuda_as_primary()
 
@@ -235,12 +279,11 @@ if __name__ == "__main__":
     qd_model.load_state_dict(torch.load(model_root_path, weights_only=True))
     qd_model.eval()
 
-    # Parse the arguments
-    parser = argparse.ArgumentParser()
-    parser.add_argument('input_file_path', type=str,
-                        help='The path to the input ndjson file')
+    if args.server:
+        sys.stdout = sys.__stdout__
+        serve(qd_model, classes)
+        sys.exit(0)
 
-    args = parser.parse_args()
     file_path = args.input_file_path
 
     # Read the data
@@ -0,0 +1,40 @@
+# Stand-in for PaintingRater.py --server that does not need torch or the model weights.
+# It answers every request with the word the drawing was made for, optionally after a delay.
+
+import argparse
+import json
+import time
+
+from EvaluatorProtocol import read_frame, write_frame, take_stdout
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--delay', type=float, default=0.0,
+                        help='Seconds to wait before answering each request')
+    parser.add_argument('--crash-after', type=int, default=0,
+                        help='Exit after this many requests, to exercise the restarts (0 never)')
+    args = parser.parse_args()
+
+    requests_in, responses_out = take_stdout()
+    print("Stub evaluator ready")
+
+    handled = 0
+    while True:
+        payload = read_frame(requests_in)
+        if payload is None:
+            break
+
+        if args.delay > 0:
+            time.sleep(args.delay)
+
+        try:
+            sample = json.loads(payload.decode("utf-8"))
+            response = {"class": sample["word"], "scores": []}
+        except Exception as e:
+            response = {"error": str(e)}
+
+        write_frame(responses_out, json.dumps(response).encode("utf-8"))
+
+        handled += 1
+        if args.crash_after > 0 and handled >= args.crash_after:
+            raise SystemExit(1)
@@ -4,83 +4,210 @@
 #include "CanvasArea.h"
 
 #include "FrameTypes.h"
+#include "Async/ParallelFor.h"
+#include "Drawing/CanvasPixelKernels.h"
+#include "Drawing/PaintingBinaryFormat.h"
+#include "Drawing/StrokeSimplifier.h"
+#include "Drawing/StrokeStepper.h"
+#include "Engine/World.h"
+#include "Framework/Application/SlateApplication.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
 #include "Misc/InteractiveProcess.h"
+#include "Misc/Paths.h"
 
-void FStroke::AddPoint(const FPoint& Point)
+DECLARE_STATS_GROUP(TEXT("SpeedArtist Canvas"), STATGROUP_SpeedArtistCanvas, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Canvas Raster"), STAT_CanvasRaster, STATGROUP_SpeedArtistCanvas);
+DECLARE_CYCLE_STAT(TEXT("Canvas Upload"), STAT_CanvasUpload, STATGROUP_SpeedArtistCanvas);
+DECLARE_MEMORY_STAT(TEXT("Canvas Pixel Memory"), STAT_CanvasPixelMemory, STATGROUP_SpeedArtistCanvas);
+
+namespace
+{
+	// Stroke segment from A to A + D with round caps
+	struct FCapsule
+	{
+		int64 Ax, Ay;
+		int64 Dx, Dy;
+		int64 LengthSquared;
+
+		FCapsule(const int32 StartX, const int32 StartY, const int32 EndX, const int32 EndY)
+			: Ax(StartX), Ay(StartY), Dx(EndX - StartX), Dy(EndY - StartY), LengthSquared(Dx * Dx + Dy * Dy)
+		{
+		}
+
+		// Exact dist(P, segment)^2 < RadiusSquared for an integer pixel
+		bool Contains(const int64 X, const int64 Y, const int64 RadiusSquared) const
+		{
+			const int64 Px = X - Ax;
+			const int64 Py = Y - Ay;
+			const int64 Projection = Px * Dx + Py * Dy;
+			if (Projection <= 0)
+				return Px * Px + Py * Py < RadiusSquared;
+
+			if (Projection >= LengthSquared)
+				return (Px - Dx) * (Px - Dx) + (Py - Dy) * (Py - Dy) < RadiusSquared;
+
+			const int64 Cross = Px * Dy - Py * Dx;
+			return Cross * Cross < RadiusSquared * LengthSquared;
+		}
+
+		double DistanceSquared(const double X, const double Y) const
+		{
+			const double Px = X - Ax;
+			const double Py = Y - Ay;
+			const double T = LengthSquared > 0 ? FMath::Clamp((Px * Dx + Py * Dy) / LengthSquared, 0.0, 1.0) : 0.0;
+			const double Qx = Px - T * Dx;
+			const double Qy = Py - T * Dy;
+			return Qx * Qx + Qy * Qy;
+		}
+
+		// Open interval of X on row Y that is closer than Radius to the segment
+		bool GetRowInterval(const double Y, const double Radius, double& OutMin, double& OutMax) const
+		{
+			bool bFound = false;
+			auto AddInterval = [&](const double Min, const double Max)
+			{
+				if (Min >= Max)
+					return;
+
+				OutMin = bFound ? FMath::Min(OutMin, Min) : Min;
+				OutMax = bFound ? FMath::Max(OutMax, Max) : Max;
+				bFound = true;
+			};
+
+			// Round caps
+			for (int i = 0; i < 2; ++i)
+			{
+				const double Cx = (double)(Ax + i * Dx);
+				const double RelY = Y - (double)(Ay + i * Dy);
+				const double HalfWidthSquared = Radius * Radius - RelY * RelY;
+				if (HalfWidthSquared > 0)
+				{
+					const double HalfWidth = FMath::Sqrt(HalfWidthSquared);
+					AddInterval(Cx - HalfWidth, Cx + HalfWidth);
+				}
+			}
+
+			if (LengthSquared == 0)
+				return bFound;
+
+			// Body, Lo < Slope * (X - Ax) + Offset < Hi for both the distance and the projection
+			double Min = -TNumericLimits<double>::Max();
+			double Max = TNumericLimits<double>::Max();
+			auto Clip = [&](const double Slope, const double Offset, const double Lo, const double Hi)
+			{
+				if (Slope == 0)
+				{
+					if (Offset <= Lo || Offset >= Hi)
+						Max = Min;
+					return;
+				}
+
+				double U1 = (Lo - Offset) / Slope;
+				double U2 = (Hi - Offset) / Slope;
+				if (Slope < 0)
+					Swap(U1, U2);
+
+				Min = FMath::Max(Min, U1);
+				Max = FMath::Min(Max, U2);
+			};
+
+			const double RelY = Y - Ay;
+			const double HalfWidth = Radius * FMath::Sqrt((double)LengthSquared);
+			Clip((double)Dy, -RelY * Dx, -HalfWidth, HalfWidth);
+			Clip((double)Dx, RelY * Dy, 0.0, (double)LengthSquared);
+			AddInterval(Ax + Min, Ax + Max);
+
+			return bFound;
+		}
+	};
+}
+
+void FStroke::AddPoint(const int32 X, const int32 Y, const uint32 TimeDelta)
 {
-	Points.Add(Point);
+	Xs.Add((int16)FMath::Clamp(X, (int32)MIN_int16, (int32)MAX_int16));
+	Ys.Add((int16)FMath::Clamp(Y, (int32)MIN_int16, (int32)MAX_int16));
+	TimeDeltas.Add(TimeDelta);
+	KeepFlags.Add(true);
+
+	// The previous simplification no longer covers the whole stroke
+	SimplifiedEps = -1.0f;
 }
 
 FString FStroke::Serialize()
 {
-	FString Xs = "[", Ys = "[";
-	for (int i = 0; i < Points.Num(); ++i)
+	FString XsJson = "[", YsJson = "[";
+	for (int i = 0; i < Num(); ++i)
 	{
 		// Skip over simplified points
-		if (Points[i].Fixed == false)
+		if (!KeepFlags[i])
 			continue;
 		
 		if (i > 0)
 		{
-			Xs.Append(",");
-			Ys.Append(",");
+			XsJson.Append(",");
+			YsJson.Append(",");
 		}
 
-		const FPoint& Point = Points[i];
-		Xs.Append(FString::Printf(TEXT("%d"), FMath::FloorToInt(Point.Coords.X)));
-		Ys.Append(FString::Printf(TEXT("%d"), FMath::FloorToInt(Point.Coords.Y)));
+		XsJson.Append(FString::Printf(TEXT("%d"), Xs[i]));
+		YsJson.Append(FString::Printf(TEXT("%d"), Ys[i]));
 	}
 
-	Xs.Append("]");
-	Ys.Append("]");
+	XsJson.Append("]");
+	YsJson.Append("]");
 	
-	return FString::Format(TEXT("[{0},{1}]"), { Xs, Ys });
+	return FString::Format(TEXT("[{0},{1}]"), { XsJson, YsJson });
 }
 
-// Algorithm used: https://en.wikipedia.org/wiki/Ramer%E2%80%93Douglas%E2%80%93Peucker_algorithm
 void FStroke::Simplify(float Eps)
 {
-	for (FPoint& Point : Points)
-		Point.Fixed = false;
+	FStrokeSimplifier::Simplify(Xs, Ys, Eps, KeepFlags);
+	SimplifiedEps = Eps;
 
-	SimplifyRec(Eps, 0, Points.Num() - 1);
+	// The whole stroke was simplified at once, nothing is left of the tail
+	NumSettledPoints = 0;
+	TailEps = -1.0f;
 }
 
-void FStroke::SimplifyRec(float Eps, int Left, int Right)
+void FStroke::SimplifyTail(float Eps)
 {
-	// Set the endpoints as fixed
-	Points[Left].Fixed = true;
-	Points[Right].Fixed = true;
+	// Points settled with another tolerance are simplified again
+	if (Eps != TailEps)
+	{
+		NumSettledPoints = 0;
+		TailEps = Eps;
+	}
 
-	// Stop if we cannot divide anymore
-	if (Left + 1 >= Right)
+	const int32 TailStart = GetTailStart();
+	if (TailStart >= Num())
 		return;
-	
-	// Find the farthest point
-	float MaxDist = -1;
-	float MaxPos = -1;
-	for (int i = Left + 1; i < Right; ++i)
+
+	// Reused by every tail simplified on this thread
+	thread_local TBitArray<> TailFlags;
+	FStrokeSimplifier::Simplify(GetXs().Slice(TailStart, Num() - TailStart), GetYs().Slice(TailStart, Num() - TailStart), Eps, TailFlags);
+	for (int32 i = 0; i < TailFlags.Num(); ++i)
+		KeepFlags[TailStart + i] = TailFlags[i];
+
+	// Settle up to the last kept point before the newest SimplifyTailPoints, which can still change
+	if (Num() - TailStart < 2 * SimplifyTailPoints)
+		return;
+
+	// A tail that never bent past Eps only kept its ends, it is settled at the last one instead of growing forever
+	NumSettledPoints = Num();
+	for (int32 i = Num() - 1 - SimplifyTailPoints; i > TailStart; --i)
 	{
-		const float Dist = FMath::PointDistToSegment(Points[i].Coords, Points[Left].Coords, Points[Right].Coords);
-		if (Dist > MaxDist)
+		if (KeepFlags[i])
 		{
-			MaxDist = Dist;
-			MaxPos = i;
+			NumSettledPoints = i + 1;
+			return;
 		}
 	}
-
-	// Stop if we've reached the desired error
-	if (MaxDist < Eps)
-		return;
-
-	SimplifyRec(Eps, Left, MaxPos);
-	SimplifyRec(Eps, MaxPos, Right);
 }
 
 void FPainting::AddStroke(const FStroke& Stroke)
 {
 	// Avoid adding empty strokes
-	if (Stroke.Points.Num() == 0)
+	if (Stroke.Num() == 0)
 		return;
 	
 	Strokes.Add(Stroke);
@@ -102,10 +229,47 @@ FString FPainting::Serialize()
 	return StrokesJson;
 }
 
-void FPainting::Simplify(float Eps)
+void FPainting::Simplify(float Eps, const bool bSingleThreaded)
 {
+	// Finished strokes are usually simplified already
+	TArray<FStroke*> Pending;
+	int32 PendingPoints = 0;
 	for (FStroke& Stroke : Strokes)
-		Stroke.Simplify(Eps);
+	{
+		if (Stroke.IsSimplified(Eps))
+			continue;
+
+		Pending.Add(&Stroke);
+		PendingPoints += Stroke.Num();
+	}
+
+	if (bSingleThreaded || PendingPoints < ParallelSimplifyMinPoints)
+	{
+		for (FStroke* Stroke : Pending)
+			Stroke->Simplify(Eps);
+		return;
+	}
+
+	// Group consecutive strokes until each batch has enough points to be worth a task
+	TArray<int32> BatchStarts;
+	int32 BatchPoints = PointsPerSimplifyBatch;
+	for (int32 i = 0; i < Pending.Num(); ++i)
+	{
+		if (BatchPoints >= PointsPerSimplifyBatch)
+		{
+			BatchStarts.Add(i);
+			BatchPoints = 0;
+		}
+
+		BatchPoints += Pending[i]->Num();
+	}
+	BatchStarts.Add(Pending.Num());
+
+	ParallelFor(BatchStarts.Num() - 1, [&](const int32 Batch)
+	{
+		for (int32 i = BatchStarts[Batch]; i < BatchStarts[Batch + 1]; ++i)
+			Pending[i]->Simplify(Eps);
+	});
 }
 
 // Sets default values
@@ -114,6 +278,8 @@ ACanvasArea::ACanvasArea()
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
+	// Flush the canvas after the input has been processed for this frame
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
 }
 
 // Called when the game starts or when spawned
@@ -124,20 +290,44 @@ void ACanvasArea::BeginPlay()
 	World = GetWorld();
 	PlayerController = World->GetFirstPlayerController();
 
+	UE_LOG(LogTemp, Display, TEXT("[ACanvasArea] Using %s pixel kernels"), FCanvasPixelKernels::GetImplementationName());
+
 	InitializeCanvas(StartWidth, StartHeight);
 	InitializeDrawingTools(StartBrushRadius);
+
+	// Slate sees every cursor move, the input actions only the last one of each frame
+	if (bSampleEveryCursorMove && FSlateApplication::IsInitialized() && World->GetGameViewport())
+	{
+		InputSampler = MakeShared<FCanvasInputSampler>(World->GetGameViewport());
+		FSlateApplication::Get().RegisterInputPreProcessor(InputSampler);
+	}
+}
+
+// Called when the actor is removed from play
+void ACanvasArea::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (InputSampler.IsValid() && FSlateApplication::IsInitialized())
+		FSlateApplication::Get().UnregisterInputPreProcessor(InputSampler);
+
+	InputSampler.Reset();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
 void ACanvasArea::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
+
+	FlushCanvas();
 }
 
 void ACanvasArea::StartDrawing()
 {
-	// Initialize a new stroke
-	CurrentStroke = FStroke{};
+	BeginStroke();
+
+	if (InputSampler.IsValid())
+		InputSampler->SetCapturing(true);
 }
 
 void ACanvasArea::Draw()
@@ -148,9 +338,26 @@ void ACanvasArea::Draw()
 		return;
 	}
 
+	// Go through every cursor move since the last frame, so fast strokes keep their shape at low frame rates
+	if (InputSampler.IsValid() && InputSampler->ConsumeSamples(PendingInputSamples) > 0)
+	{
+		for (const FCanvasInputSample& Sample : PendingInputSamples)
+			DrawAtViewportPosition(Sample.ViewportPosition, Sample.Time);
+
+		return;
+	}
+
+	// The cursor did not move, or there is no sampler
+	float MouseX, MouseY;
+	if (PlayerController->GetMousePosition(MouseX, MouseY))
+		DrawAtViewportPosition(FVector2D(MouseX, MouseY), FPlatformTime::Seconds());
+}
+
+void ACanvasArea::DrawAtViewportPosition(const FVector2D& ViewportPosition, const double Time)
+{
 	FVector WorldPosition{0};
 	FVector WorldDirection{0};
-	PlayerController->DeprojectMousePositionToWorld(WorldPosition, WorldDirection);
+	PlayerController->DeprojectScreenPositionToWorld(ViewportPosition.X, ViewportPosition.Y, WorldPosition, WorldDirection);
 
 	FHitResult HitResult;
 	
@@ -184,39 +391,87 @@ void ACanvasArea::Draw()
 
 	const UE::Math::TVector2 Coords(floorf(NormalizedWidth * CanvasWidth), floorf(NormalizedHeight * CanvasHeight));
 
-	// Draw a line from the previous point
-	if (PrevCoords.X >= 0 && PrevCoords.Y >= 0 && PrevCoords.X < CanvasWidth && PrevCoords.Y < CanvasHeight)
-	{
-		const float DistanceBetweenPoints = UE::Math::TVector2<float>::Distance(PrevCoords, Coords);
-		const float StepCount = floorf(DistanceBetweenPoints / (Radius / 2.0f));
+	const bool bHasPrevCoords = PrevCoords.X >= 0 && PrevCoords.Y >= 0 && PrevCoords.X < CanvasWidth && PrevCoords.Y < CanvasHeight;
 
-		if (StepCount > 0)
-		{
-			const float Step = DistanceBetweenPoints / StepCount;
-		
-			for (float Alpha = 0.0f; Alpha < DistanceBetweenPoints; Alpha += Step)
-			{
-				const UE::Math::TVector2<float> NewCoords = UE::Geometry::Lerp(PrevCoords, Coords, Alpha / DistanceBetweenPoints);
-				DrawDot(NewCoords.X, NewCoords.Y);
-			}
-		}
+	// Several samples often land on the same pixel, they add nothing to the stroke
+	if (bHasPrevCoords && PrevCoords == Coords)
+		return;
+
+	// The cursor came back from outside the canvas. The stroke ends where it left, so redrawing the painting does not
+	// join the two points across the gap, and a new one starts here.
+	if (!bHasPrevCoords && CurrentStroke.Num() > 0)
+	{
+		EndStroke();
+		BeginStroke();
 	}
-	
-	DrawDot(Coords.X, Coords.Y);
+
+	// Draw from the previous point, or a single dot when the stroke starts here
+	const FIntPoint Point((int32)Coords.X, (int32)Coords.Y);
+	DrawStrokeStep(bHasPrevCoords ? FIntPoint((int32)PrevCoords.X, (int32)PrevCoords.Y) : Point, Point);
+
+	// Add a new point to the stroke, timed relative to the previous one
+	const uint32 TimeDelta = CurrentStroke.Num() > 0 ? (uint32)FMath::Max(FMath::RoundToInt64((Time - PrevPointTime) * 1000.0), (int64)0) : 0;
+	CurrentStroke.AddPoint(Point.X, Point.Y, TimeDelta);
+
+	// Simplify as the stroke grows, a tail at a time, for the live predictions
+	if (CurrentStroke.Num() % FStroke::SimplifyTailPoints == 0)
+		CurrentStroke.SimplifyTail(StrokeSimplifyEps);
 
 	// Store the current point
 	PrevCoords = Coords;
-
-	// Add a new point to the stroke
-	CurrentStroke.AddPoint(FPoint{ FVector{ Coords.X, Coords.Y, 0 }});
+	PrevPointTime = Time;
 }
 
 void ACanvasArea::StopDrawing()
 {
 	PrevCoords = UE::Math::TVector2<float>(-1, -1);
 
+	if (InputSampler.IsValid())
+		InputSampler->SetCapturing(false);
+
+	EndStroke();
+}
+
+void ACanvasArea::BeginStroke()
+{
+	// Initialize a new stroke
+	CurrentStroke = FStroke{};
+	bStrokeInProgress = true;
+
+	// Record the tiles the stroke is about to modify
+	CurrentUndoStep = FCanvasUndoStep{};
+	bRecordingUndoStep = true;
+}
+
+void ACanvasArea::EndStroke()
+{
+	// Simplify the finished stroke now, so submitting the painting only has to deal with the open one.
+	// The whole stroke goes through RDP, the tails simplified while it was drawn were only for the live predictions.
+	bStrokeInProgress = false;
+	CurrentStroke.Simplify(StrokeSimplifyEps);
+
 	// Add the stroke to the painting
 	CurrentPainting.AddStroke(CurrentStroke);
+
+	if (!bRecordingUndoStep)
+		return;
+	
+	bRecordingUndoStep = false;
+	for (const FCanvasTileSnapshot& Snapshot : CurrentUndoStep.Tiles)
+		CapturedUndoTiles[Snapshot.TileIndex] = false;
+
+	// Empty strokes are not part of the painting, so there is nothing to undo either
+	if (CurrentStroke.Num() > 0)
+	{
+		CurrentUndoStep.Stroke = CurrentStroke;
+		UndoSteps.Add(MoveTemp(CurrentUndoStep));
+		RedoSteps.Reset();
+
+		if (UndoSteps.Num() > MaxUndoSteps)
+			UndoSteps.RemoveAt(0);
+	}
+	
+	CurrentUndoStep = FCanvasUndoStep{};
 }
 
 void ACanvasArea::InitializeCanvas(const int32 PixelsH, const int32 PixelsV)
@@ -225,99 +480,428 @@ void ACanvasArea::InitializeCanvas(const int32 PixelsH, const int32 PixelsV)
 	CanvasWidth = PixelsH;
 	CanvasHeight = PixelsV;
 	
-	DynamicCanvas = UTexture2D::CreateTransient(CanvasWidth, CanvasHeight);
+	// Coverage canvases are a single linear channel, the material turns them into ink and paper colors
+	bCanvasIsCoverage = CanvasPixelFormat == ECanvasPixelFormat::Coverage8;
+	
+	DynamicCanvas = UTexture2D::CreateTransient(CanvasWidth, CanvasHeight, bCanvasIsCoverage ? PF_G8 : PF_B8G8R8A8);
 #if WITH_EDITORONLY_DATA
 	DynamicCanvas->MipGenSettings = TextureMipGenSettings::TMGS_NoMipmaps;
 #endif
-	DynamicCanvas->CompressionSettings = TextureCompressionSettings::TC_VectorDisplacementmap;
-	DynamicCanvas->SRGB = 1;
+	DynamicCanvas->CompressionSettings = bCanvasIsCoverage ? TextureCompressionSettings::TC_Grayscale : TextureCompressionSettings::TC_VectorDisplacementmap;
+	DynamicCanvas->SRGB = bCanvasIsCoverage ? 0 : 1;
 	DynamicCanvas->AddToRoot();
 	DynamicCanvas->Filter = TextureFilter::TF_Nearest;
 	DynamicCanvas->UpdateResource();
 	
-	EchoUpdateTextureRegion = std::unique_ptr<FUpdateTextureRegion2D>(new FUpdateTextureRegion2D(0, 0, 0, 0, CanvasWidth, CanvasHeight));
-	
 	// Buffers initialization
-	BytesPerPixel = 4; // r g b a
+	BytesPerPixel = bCanvasIsCoverage ? 1 : 4; // coverage or b g r a
 	BufferPitch = CanvasWidth * BytesPerPixel;
 	BufferSize = CanvasWidth * CanvasHeight * BytesPerPixel;
-	
-	CanvasPixelData = std::unique_ptr<uint8[]>(new uint8[BufferSize]);
+
+	bCanvasIsTiled = bUseTiledStorage;
+	if (bCanvasIsTiled)
+	{
+		CanvasPixelData.reset();
+		TileStore.Initialize(CanvasWidth, CanvasHeight, BytesPerPixel, GetPaperPixel());
+	}
+	else
+	{
+		CanvasPixelData = std::unique_ptr<uint8[]>(new uint8[BufferSize]);
+	}
+
+	// A fresh ring, the previous one stays alive until its pending uploads are done
+	UploadRing = MakeShared<FCanvasUploadRing, ESPMode::ThreadSafe>(NumUploadSlots);
+
+	// Undo snapshots use the same tile grid in both storage modes
+	UndoTileCountX = FMath::DivideAndRoundUp(CanvasWidth, FCanvasTileStore::TileSize);
+	CapturedUndoTiles.Init(false, UndoTileCountX * FMath::DivideAndRoundUp(CanvasHeight, FCanvasTileStore::TileSize));
 	
 	ClearCanvas();
 }
 
 void ACanvasArea::UpdateCanvas()
 {
-	if (EchoUpdateTextureRegion)
+	if (DirtyRects.Num() == 0 || !IsValid(DynamicCanvas) || !UploadRing)
+		return;
+
+	// UpdateTextureRegions drops the upload without calling the cleanup callback when there is no resource, which would
+	// leave the slot in flight for good, so the regions stay dirty until the texture has one
+	if (DynamicCanvas->GetResource() == nullptr)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_CanvasUpload);
+
+	// Dirty pixels are copied into a staging slot the render thread owns until the upload is done,
+	// blank cells of the tiled storage are sent straight from the immutable shared blank tile
+	constexpr int32 TileSize = FCanvasTileStore::TileSize;
+	TArray<FUpdateTextureRegion2D> BlankRegions;
+	TArray<FUpdateTextureRegion2D> StagedRegions;
+	int32 StagingPitch = 0;
+	int32 StagingRows = 0;
+	
+	for (const FIntRect& Rect : DirtyRects)
+	{
+		if (!bCanvasIsTiled)
+		{
+			StagedRegions.Add(FUpdateTextureRegion2D(Rect.Min.X, Rect.Min.Y, 0, StagingRows, Rect.Width(), Rect.Height()));
+			StagingPitch = FMath::Max(StagingPitch, Rect.Width() * BytesPerPixel);
+			StagingRows += Rect.Height();
+			continue;
+		}
+		
+		for (int32 TileY = Rect.Min.Y / TileSize; TileY * TileSize < Rect.Max.Y; ++TileY)
+		{
+			for (int32 TileX = Rect.Min.X / TileSize; TileX * TileSize < Rect.Max.X; ++TileX)
+			{
+				FIntRect Cell(TileX * TileSize, TileY * TileSize, (TileX + 1) * TileSize, (TileY + 1) * TileSize);
+				Cell.Clip(Rect);
+				if (Cell.IsEmpty())
+					continue;
+
+				if (!TileStore.IsTileAllocated(TileX, TileY))
+				{
+					BlankRegions.Add(FUpdateTextureRegion2D(Cell.Min.X, Cell.Min.Y, Cell.Min.X % TileSize, Cell.Min.Y % TileSize, Cell.Width(), Cell.Height()));
+					continue;
+				}
+
+				StagedRegions.Add(FUpdateTextureRegion2D(Cell.Min.X, Cell.Min.Y, 0, StagingRows, Cell.Width(), Cell.Height()));
+				StagingPitch = TileStore.GetTilePitch();
+				StagingRows += Cell.Height();
+			}
+		}
+	}
+
+	int32 Slot = INDEX_NONE;
+	if (StagedRegions.Num() > 0)
+	{
+		// Every slot is still being read by the render thread, keep the regions dirty and try again next flush
+		Slot = UploadRing->AcquireSlot(StagingRows * StagingPitch);
+		if (Slot == INDEX_NONE)
+			return;
+	}
+
+	DirtyRects.Reset();
+
+	if (BlankRegions.Num() > 0)
 	{
-		DynamicCanvas->UpdateTextureRegions((int32)0, (uint32)1, EchoUpdateTextureRegion.get(), (uint32)BufferPitch, (uint32)BytesPerPixel, CanvasPixelData.get());
+		FUpdateTextureRegion2D* Regions = new FUpdateTextureRegion2D[BlankRegions.Num()];
+		FMemory::Memcpy(Regions, BlankRegions.GetData(), BlankRegions.Num() * sizeof(FUpdateTextureRegion2D));
+
+		// The reference keeps the blank tile alive until the render thread is done with it
+		FCanvasTileStore::FBlankTileRef BlankTile = TileStore.GetBlankTile();
+		DynamicCanvas->UpdateTextureRegions((int32)0, (uint32)BlankRegions.Num(), Regions, (uint32)TileStore.GetTilePitch(), (uint32)BytesPerPixel, BlankTile->GetData(),
+			[BlankTile](uint8* SrcData, const FUpdateTextureRegion2D* UploadedRegions)
+			{
+				delete[] UploadedRegions;
+			});
+	}
+
+	if (StagedRegions.Num() > 0)
+	{
+		uint8* StagingData = UploadRing->GetSlotData(Slot);
+		for (const FUpdateTextureRegion2D& Region : StagedRegions)
+		{
+			for (uint32 Row = 0; Row < Region.Height; ++Row)
+			{
+				const int32 X = Region.DestX;
+				const int32 Y = Region.DestY + Row;
+				const uint8* Source = bCanvasIsTiled ? TileStore.GetPixel(X, Y) : CanvasPixelData.get() + Y * BufferPitch + X * BytesPerPixel;
+				FMemory::Memcpy(StagingData + (Region.SrcY + Row) * StagingPitch, Source, Region.Width * BytesPerPixel);
+			}
+		}
+		
+		FUpdateTextureRegion2D* Regions = new FUpdateTextureRegion2D[StagedRegions.Num()];
+		FMemory::Memcpy(Regions, StagedRegions.GetData(), StagedRegions.Num() * sizeof(FUpdateTextureRegion2D));
+
+		// The slot goes back to the ring once the render thread has read it
+		DynamicCanvas->UpdateTextureRegions((int32)0, (uint32)StagedRegions.Num(), Regions, (uint32)StagingPitch, (uint32)BytesPerPixel, StagingData,
+			[Ring = UploadRing, Slot](uint8* SrcData, const FUpdateTextureRegion2D* UploadedRegions)
+			{
+				delete[] UploadedRegions;
+				Ring->ReleaseSlot(Slot);
+			});
 	}
 }
 
+void ACanvasArea::FlushCanvas()
+{
+	UpdateCanvas();
+
+	SET_MEMORY_STAT(STAT_CanvasPixelMemory, bCanvasIsTiled ? TileStore.GetAllocatedBytes() : BufferSize);
+}
+
 void ACanvasArea::ClearCanvas()
 {
-	uint8* canvasPixelPtr = CanvasPixelData.get();
-	for (int i = 0; i < CanvasWidth * CanvasHeight; ++i)
 	{
-		SetPixelColor(canvasPixelPtr, 255, 255, 255, 0); // White
-		canvasPixelPtr += BytesPerPixel;
+		SCOPE_CYCLE_COUNTER(STAT_CanvasRaster);
+		ClearPixels();
 	}
-	
-	UpdateCanvas();
+
+	MarkDirty(FIntRect(0, 0, CanvasWidth, CanvasHeight));
+	if (!bDeferCanvasUpload)
+		UpdateCanvas();
 
 	CurrentPainting = FPainting{};
+	++PaintingRevision;
+	ClearUndoHistory();
 }
 
 void ACanvasArea::InitializeDrawingTools(const int32 BrushRadius)
 {
 	Radius = BrushRadius;
-	BrushBufferSize = Radius * Radius * 4 * BytesPerPixel; //2r*2r * bpp
-	CanvasBrushMask = std::unique_ptr<uint8[]>(new uint8[BrushBufferSize]);
-	uint8* canvasBrushPixelPtr = CanvasBrushMask.get();
-	for (int px = -Radius; px < Radius; ++px)
+
+	// Precompute the covered run of each brush row (px*px + py*py < r*r)
+	BrushSpans.SetNum(2 * Radius);
+	for (int py = -Radius; py < Radius; ++py)
 	{
-		for (int py = -Radius; py < Radius; ++py)
+		FBrushSpan& Span = BrushSpans[py + Radius];
+		const int32 Remaining = Radius * Radius - py * py;
+		if (Remaining <= 0)
 		{
-			int32 tx = px + Radius;
-			int32 ty = py + Radius;
-			canvasBrushPixelPtr = CanvasBrushMask.get() + (tx +  + ty * 2 * Radius) * BytesPerPixel;
-			if (px*px + py*py < Radius*Radius)
-			{
-				SetPixelColor(canvasBrushPixelPtr, 0, 0, 0, 255); //black alpha 255 - bgra
-			}
-			else
-			{
-				SetPixelColor(canvasBrushPixelPtr, 0, 0, 0, 0); // alpha 0
-			}
+			Span = FBrushSpan{};
+			continue;
 		}
+
+		// Largest half width with HalfWidth^2 < Remaining
+		int32 HalfWidth = FMath::FloorToInt(FMath::Sqrt((float)Remaining));
+		while (HalfWidth * HalfWidth >= Remaining)
+			--HalfWidth;
+		while ((HalfWidth + 1) * (HalfWidth + 1) < Remaining)
+			++HalfWidth;
+
+		Span.Start = -HalfWidth;
+		Span.End = HalfWidth + 1;
 	}
 }
 
 void ACanvasArea::DrawDot(const int32 PixelCoordX, const int32 PixelCoordY)
 {
-	uint8* canvasPixelPtr = CanvasPixelData.get();
-	const uint8* canvasBrushPixelPtr = CanvasBrushMask.get();
-	for (int px = -Radius; px < Radius; ++px)
-	{
-		for (int py = -Radius; py < Radius; ++py) 
-		{ 
-			int32 tbx = px + Radius; 
-			int32 tby = py + Radius; 
-			canvasBrushPixelPtr = CanvasBrushMask.get() + (tbx + tby * 2* Radius) * BytesPerPixel; 
-			if (*(canvasBrushPixelPtr + 3) == 255) // check the alpha value of the pixel of the brush mask 
-			{ 
-				int32 tx = PixelCoordX + px; 
-				int32 ty = PixelCoordY + py; 
-				if (tx >= 0 && tx < CanvasWidth && ty >= 0 && ty < CanvasHeight)
-				{
-					canvasPixelPtr = CanvasPixelData.get() + (tx + ty * CanvasWidth) * BytesPerPixel;
-					SetPixelColor(canvasPixelPtr, *(canvasBrushPixelPtr + 2), *(canvasBrushPixelPtr + 1), *(canvasBrushPixelPtr), *(canvasBrushPixelPtr + 3));
-				}
-			}
+	SCOPE_CYCLE_COUNTER(STAT_CanvasRaster);
+
+	RasterizeDot(PixelCoordX, PixelCoordY, FIntRect(0, 0, CanvasWidth, CanvasHeight));
+	MarkDirty(FIntRect(PixelCoordX - Radius, PixelCoordY - Radius, PixelCoordX + Radius, PixelCoordY + Radius));
+	
+	if (!bDeferCanvasUpload)
+		UpdateCanvas();
+}
+
+void ACanvasArea::DrawSegment(const int32 StartX, const int32 StartY, const int32 EndX, const int32 EndY)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CanvasRaster);
+
+	RasterizeSegment(StartX, StartY, EndX, EndY, FIntRect(0, 0, CanvasWidth, CanvasHeight));
+	MarkDirty(GetStrokeStepBounds(FIntPoint(StartX, StartY), FIntPoint(EndX, EndY)));
+	
+	if (!bDeferCanvasUpload)
+		UpdateCanvas();
+}
+
+bool ACanvasArea::RasterizePainting(const FPainting& Painting, const bool bSingleThreaded)
+{
+	if (bStrokeInProgress)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[ACanvasArea] Unable to redraw the canvas while a stroke is being drawn"));
+		return false;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_CanvasRaster);
+
+	// Flatten the strokes into steps, along with the rows each of them touches
+	struct FBandedStrokeStep
+	{
+		FIntPoint Start;
+		FIntPoint End;
+		int32 MinY;
+		int32 MaxY;
+	};
+	
+	TArray<FBandedStrokeStep> Steps;
+	for (const FStroke& Stroke : Painting.Strokes)
+	{
+		for (int i = 0; i < Stroke.Num(); ++i)
+		{
+			const FIntPoint Start = Stroke.GetPoint(FMath::Max(i - 1, 0));
+			const FIntPoint End = Stroke.GetPoint(i);
+
+			const FIntRect Bounds = GetStrokeStepBounds(Start, End);
+			Steps.Add(FBandedStrokeStep{ Start, End, Bounds.Min.Y, Bounds.Max.Y });
 		}
 	}
-	UpdateCanvas();
+
+	// The redraw replaces the canvas as a whole, it is not an undoable stroke
+	ClearUndoHistory();
+	CurrentPainting = Painting;
+	++PaintingRevision;
+	
+	ClearPixels();
+
+	// Bands are made of whole tile rows so that no tile is ever shared between two threads.
+	// Each band draws every step touching it in painting order, which keeps the result identical to a serial redraw.
+	constexpr int32 BandsPerWorker = 4;
+	constexpr int32 TileSize = FCanvasTileStore::TileSize;
+	const int32 NumWorkers = bSingleThreaded ? 1 : FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads(), 1);
+	const int32 BandHeight = FMath::Max(Align(FMath::DivideAndRoundUp(CanvasHeight, NumWorkers * BandsPerWorker), TileSize), TileSize);
+	const int32 NumBands = FMath::DivideAndRoundUp(CanvasHeight, BandHeight);
+
+	ParallelFor(NumBands, [&](const int32 BandIndex)
+	{
+		const FIntRect Band(0, BandIndex * BandHeight, CanvasWidth, FMath::Min((BandIndex + 1) * BandHeight, CanvasHeight));
+		for (const FBandedStrokeStep& Step : Steps)
+		{
+			if (Step.MaxY > Band.Min.Y && Step.MinY < Band.Max.Y)
+				RasterizeStrokeStep(Step.Start, Step.End, Band);
+		}
+	}, bSingleThreaded ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	MarkDirty(FIntRect(0, 0, CanvasWidth, CanvasHeight));
+	
+	if (!bDeferCanvasUpload)
+		UpdateCanvas();
+
+	return true;
+}
+
+void ACanvasArea::CopyPixels(TArray<uint8>& OutPixels) const
+{
+	OutPixels.SetNumUninitialized(BufferSize);
+	if (!bCanvasIsTiled)
+	{
+		FMemory::Memcpy(OutPixels.GetData(), CanvasPixelData.get(), BufferSize);
+		return;
+	}
+
+	// Row by row, one run per tile
+	constexpr int32 TileSize = FCanvasTileStore::TileSize;
+	for (int32 Y = 0; Y < CanvasHeight; ++Y)
+	{
+		for (int32 X = 0; X < CanvasWidth; X += TileSize)
+		{
+			const int32 Count = FMath::Min(TileSize, CanvasWidth - X);
+			FMemory::Memcpy(OutPixels.GetData() + Y * BufferPitch + X * BytesPerPixel, TileStore.GetPixel(X, Y), Count * BytesPerPixel);
+		}
+	}
+}
+
+void ACanvasArea::ClearPixels()
+{
+	if (bCanvasIsTiled)
+		TileStore.Clear(GetPaperPixel());
+	else if (bCanvasIsCoverage)
+		FCanvasPixelKernels::FillCoverageSpan(CanvasPixelData.get(), BufferSize, PaperCoverage);
+	else
+		FCanvasPixelKernels::FillRect(reinterpret_cast<FColor*>(CanvasPixelData.get()), CanvasWidth, CanvasHeight, CanvasWidth, PaperColor);
+}
+
+const uint8* ACanvasArea::GetPaperPixel() const
+{
+	return bCanvasIsCoverage ? &PaperCoverage : reinterpret_cast<const uint8*>(&PaperColor);
+}
+
+void ACanvasArea::DrawStrokeStep(const FIntPoint Start, const FIntPoint End)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CanvasRaster);
+
+	RasterizeStrokeStep(Start, End, FIntRect(0, 0, CanvasWidth, CanvasHeight));
+	MarkDirty(GetStrokeStepBounds(Start, End));
+	
+	if (!bDeferCanvasUpload)
+		UpdateCanvas();
+}
+
+void ACanvasArea::RasterizeStrokeStep(const FIntPoint Start, const FIntPoint End, const FIntRect& Clip)
+{
+	if (StrokeRasterMode == EStrokeRasterMode::Capsules)
+	{
+		RasterizeSegment(Start.X, Start.Y, End.X, End.Y, Clip);
+		return;
+	}
+
+	// Stamp the brush along the line from the previous point, ending on End
+	FStrokeStepper Stepper(Start, End, Radius);
+	FIntPoint Center;
+	while (Stepper.Next(Center))
+		RasterizeDot(Center.X, Center.Y, Clip);
+}
+
+FIntRect ACanvasArea::GetStrokeStepBounds(const FIntPoint Start, const FIntPoint End) const
+{
+	// Covers both the stamps and the capsule, anti-aliased edges included
+	const int32 Padding = Radius + 1;
+	return FIntRect(FMath::Min(Start.X, End.X) - Padding, FMath::Min(Start.Y, End.Y) - Padding,
+		FMath::Max(Start.X, End.X) + Padding + 1, FMath::Max(Start.Y, End.Y) + Padding + 1);
+}
+
+void ACanvasArea::RasterizeDot(const int32 PixelCoordX, const int32 PixelCoordY, const FIntRect& Clip)
+{
+	// Clip the brush rows once
+	const int32 MinY = FMath::Max(PixelCoordY - Radius, Clip.Min.Y);
+	const int32 MaxY = FMath::Min(PixelCoordY + Radius, Clip.Max.Y);
+	for (int32 y = MinY; y < MaxY; ++y)
+	{
+		const FBrushSpan& Span = BrushSpans[y - PixelCoordY + Radius];
+		FillRowSpan(y, FMath::Max(PixelCoordX + Span.Start, Clip.Min.X), FMath::Min(PixelCoordX + Span.End, Clip.Max.X));
+	}
+}
+
+void ACanvasArea::RasterizeSegment(const int32 StartX, const int32 StartY, const int32 EndX, const int32 EndY, const FIntRect& Clip)
+{
+	const FCapsule Capsule(StartX, StartY, EndX, EndY);
+	const int32 Padding = bAntiAliasedStrokes ? Radius + 1 : Radius;
+	
+	const int32 MinY = FMath::Max(FMath::Min(StartY, EndY) - Padding, Clip.Min.Y);
+	const int32 MaxY = FMath::Min(FMath::Max(StartY, EndY) + Padding + 1, Clip.Max.Y);
+	for (int32 y = MinY; y < MaxY; ++y)
+	{
+		double Min, Max;
+		
+		if (!bAntiAliasedStrokes)
+		{
+			if (!Capsule.GetRowInterval(y, Radius, Min, Max))
+				continue;
+
+			// Snap the interval to the exact set of covered pixels
+			const int64 RadiusSquared = (int64)Radius * Radius;
+			int32 First = FMath::FloorToInt(Min);
+			int32 Last = FMath::CeilToInt(Max);
+			while (First <= Last && !Capsule.Contains(First, y, RadiusSquared))
+				++First;
+			while (Last >= First && !Capsule.Contains(Last, y, RadiusSquared))
+				--Last;
+
+			FillRowSpan(y, FMath::Max(First, Clip.Min.X), FMath::Min(Last + 1, Clip.Max.X));
+			continue;
+		}
+
+		// Pixels within Radius - 0.5 are fully covered, the ones up to Radius + 0.5 get partial coverage
+		if (!Capsule.GetRowInterval(y, Radius + 0.5, Min, Max))
+			continue;
+		
+		const int32 OuterStart = FMath::Max(FMath::FloorToInt(Min) + 1, Clip.Min.X);
+		const int32 OuterEnd = FMath::Min(FMath::CeilToInt(Max), Clip.Max.X);
+
+		int32 InnerStart = OuterEnd, InnerEnd = OuterEnd;
+		if (Radius > 0.5 && Capsule.GetRowInterval(y, Radius - 0.5, Min, Max))
+		{
+			InnerStart = FMath::Clamp(FMath::FloorToInt(Min) + 1, OuterStart, OuterEnd);
+			InnerEnd = FMath::Clamp(FMath::CeilToInt(Max), InnerStart, OuterEnd);
+		}
+
+		auto BlendEdgePixel = [&](const int32 x)
+		{
+			const double Coverage = FMath::Clamp(Radius + 0.5 - FMath::Sqrt(Capsule.DistanceSquared(x, y)), 0.0, 1.0);
+			FColor EdgeColor = BrushColor;
+			EdgeColor.A = (uint8)FMath::RoundToInt(Coverage * BrushColor.A);
+			BlendRowSpan(y, x, x + 1, EdgeColor);
+		};
+
+		for (int32 x = OuterStart; x < InnerStart; ++x)
+			BlendEdgePixel(x);
+		
+		FillRowSpan(y, InnerStart, InnerEnd);
+		
+		for (int32 x = InnerEnd; x < OuterEnd; ++x)
+			BlendEdgePixel(x);
+	}
 }
 
 void ACanvasArea::SaveTexture()
@@ -335,16 +919,357 @@ void ACanvasArea::SaveTexture()
 	// TODO: More likely, save the strokes and points in a data structure (create a new class for it) and save this info on the disk
 }
 
+bool ACanvasArea::UndoStroke()
+{
+	if (bRecordingUndoStep || UndoSteps.Num() == 0)
+		return false;
+
+	FCanvasUndoStep Step = UndoSteps.Pop();
+	SwapUndoTiles(Step);
+
+	// Strokes are only ever appended, so the undone one is the last of the painting
+	if (CurrentPainting.Strokes.Num() > 0)
+		CurrentPainting.Strokes.Pop();
+	++PaintingRevision;
+	
+	RedoSteps.Add(MoveTemp(Step));
+	
+	if (!bDeferCanvasUpload)
+		UpdateCanvas();
+	
+	return true;
+}
+
+bool ACanvasArea::RedoStroke()
+{
+	if (bRecordingUndoStep || RedoSteps.Num() == 0)
+		return false;
+
+	FCanvasUndoStep Step = RedoSteps.Pop();
+	SwapUndoTiles(Step);
+	
+	CurrentPainting.AddStroke(Step.Stroke);
+	++PaintingRevision;
+	
+	UndoSteps.Add(MoveTemp(Step));
+	
+	if (!bDeferCanvasUpload)
+		UpdateCanvas();
+	
+	return true;
+}
+
 FPainting& ACanvasArea::GetCurrentPainting()
 {
 	return CurrentPainting;
 }
 
-void ACanvasArea::SetPixelColor(uint8*& Pointer, uint8 Red, uint8 Green, uint8 Blue, uint8 Alpha)
+void ACanvasArea::ClearUndoHistory()
+{
+	UndoSteps.Reset();
+	RedoSteps.Reset();
+
+	// A stroke in progress starts over from the current contents
+	for (const FCanvasTileSnapshot& Snapshot : CurrentUndoStep.Tiles)
+		CapturedUndoTiles[Snapshot.TileIndex] = false;
+	
+	CurrentUndoStep = FCanvasUndoStep{};
+}
+
+void ACanvasArea::CaptureTilesForUndo(const int32 Y, const int32 StartX, const int32 EndX)
+{
+	constexpr int32 TileSize = FCanvasTileStore::TileSize;
+	const int32 TileRowStart = (Y / TileSize) * UndoTileCountX;
+	
+	for (int32 TileX = StartX / TileSize; TileX <= (EndX - 1) / TileSize; ++TileX)
+	{
+		const int32 TileIndex = TileRowStart + TileX;
+		if (CapturedUndoTiles[TileIndex])
+			continue;
+
+		CapturedUndoTiles[TileIndex] = true;
+
+		// Save the tile before its first modification by this stroke
+		FCanvasTileSnapshot& Snapshot = CurrentUndoStep.Tiles.AddDefaulted_GetRef();
+		Snapshot.TileIndex = TileIndex;
+
+		if (bCanvasIsTiled)
+		{
+			TileStore.CopyTile(TileIndex, Snapshot.Pixels);
+			continue;
+		}
+		
+		const FIntRect TileRect = GetTileRect(TileIndex);
+		const int32 RowBytes = TileRect.Width() * BytesPerPixel;
+		Snapshot.Pixels.SetNumUninitialized(RowBytes * TileRect.Height());
+		for (int32 Row = 0; Row < TileRect.Height(); ++Row)
+		{
+			FMemory::Memcpy(Snapshot.Pixels.GetData() + Row * RowBytes,
+				CanvasPixelData.get() + (TileRect.Min.Y + Row) * BufferPitch + TileRect.Min.X * BytesPerPixel, RowBytes);
+		}
+	}
+}
+
+void ACanvasArea::SwapUndoTiles(FCanvasUndoStep& Step)
+{
+	for (FCanvasTileSnapshot& Snapshot : Step.Tiles)
+	{
+		const FIntRect TileRect = GetTileRect(Snapshot.TileIndex);
+		TArray<uint8> CurrentPixels;
+
+		if (bCanvasIsTiled)
+		{
+			TileStore.CopyTile(Snapshot.TileIndex, CurrentPixels);
+			TileStore.RestoreTile(Snapshot.TileIndex, Snapshot.Pixels);
+		}
+		else
+		{
+			const int32 RowBytes = TileRect.Width() * BytesPerPixel;
+			CurrentPixels.SetNumUninitialized(RowBytes * TileRect.Height());
+			for (int32 Row = 0; Row < TileRect.Height(); ++Row)
+			{
+				uint8* CanvasRow = CanvasPixelData.get() + (TileRect.Min.Y + Row) * BufferPitch + TileRect.Min.X * BytesPerPixel;
+				FMemory::Memcpy(CurrentPixels.GetData() + Row * RowBytes, CanvasRow, RowBytes);
+				FMemory::Memcpy(CanvasRow, Snapshot.Pixels.GetData() + Row * RowBytes, RowBytes);
+			}
+		}
+
+		// Keep the replaced contents, so the same step can be applied the other way around
+		Snapshot.Pixels = MoveTemp(CurrentPixels);
+		MarkDirty(TileRect);
+	}
+}
+
+FIntRect ACanvasArea::GetTileRect(const int32 TileIndex) const
+{
+	constexpr int32 TileSize = FCanvasTileStore::TileSize;
+	const int32 TileX = TileIndex % UndoTileCountX;
+	const int32 TileY = TileIndex / UndoTileCountX;
+
+	FIntRect TileRect(TileX * TileSize, TileY * TileSize, (TileX + 1) * TileSize, (TileY + 1) * TileSize);
+	TileRect.Clip(FIntRect(0, 0, CanvasWidth, CanvasHeight));
+	
+	return TileRect;
+}
+
+void ACanvasArea::FillRowSpan(const int32 Y, const int32 StartX, const int32 EndX)
+{
+	if (StartX >= EndX)
+		return;
+
+	if (bRecordingUndoStep)
+		CaptureTilesForUndo(Y, StartX, EndX);
+
+	// FColor matches the BGRA byte order of the canvas
+	auto FillRun = [this](uint8* Pixels, const int32 Count)
+	{
+		if (bCanvasIsCoverage)
+			FCanvasPixelKernels::FillCoverageSpan(Pixels, Count, InkCoverage);
+		else
+			FCanvasPixelKernels::FillSpan(reinterpret_cast<FColor*>(Pixels), Count, BrushColor);
+	};
+
+	if (bCanvasIsTiled)
+		TileStore.ForEachMutableRun(Y, StartX, EndX, FillRun);
+	else
+		FillRun(CanvasPixelData.get() + Y * BufferPitch + StartX * BytesPerPixel, EndX - StartX);
+}
+
+void ACanvasArea::BlendRowSpan(const int32 Y, const int32 StartX, const int32 EndX, const FColor Color)
+{
+	if (StartX >= EndX)
+		return;
+
+	if (bRecordingUndoStep)
+		CaptureTilesForUndo(Y, StartX, EndX);
+
+	// Coverage canvases only keep the opacity of the color
+	auto BlendRun = [this, Color](uint8* Pixels, const int32 Count)
+	{
+		if (bCanvasIsCoverage)
+			FCanvasPixelKernels::BlendCoverageSpan(Pixels, Count, InkCoverage, Color.A);
+		else
+			FCanvasPixelKernels::BlendSpan(reinterpret_cast<FColor*>(Pixels), Count, Color);
+	};
+
+	if (bCanvasIsTiled)
+		TileStore.ForEachMutableRun(Y, StartX, EndX, BlendRun);
+	else
+		BlendRun(CanvasPixelData.get() + Y * BufferPitch + StartX * BytesPerPixel, EndX - StartX);
+}
+
+void ACanvasArea::MarkDirty(const FIntRect& Rect)
+{
+	FIntRect NewRect = Rect;
+	NewRect.Clip(FIntRect(0, 0, CanvasWidth, CanvasHeight));
+	if (NewRect.IsEmpty())
+		return;
+
+	// Absorb every region that is cheaper to upload together with the new one than separately
+	for (int i = 0; i < DirtyRects.Num(); )
+	{
+		if (GetMergeCost(DirtyRects[i], NewRect) <= 0)
+		{
+			NewRect.Union(DirtyRects[i]);
+			DirtyRects.RemoveAtSwap(i);
+
+			// The grown region may now be worth merging with one we already skipped
+			i = 0;
+			continue;
+		}
+		
+		++i;
+	}
+
+	DirtyRects.Add(NewRect);
+
+	// Too many regions, merge the cheapest pairs until we are back under the limit
+	while (DirtyRects.Num() > MaxDirtyRects)
+	{
+		int64 BestCost = TNumericLimits<int64>::Max();
+		int BestA = 0, BestB = 1;
+		for (int a = 0; a < DirtyRects.Num(); ++a)
+		{
+			for (int b = a + 1; b < DirtyRects.Num(); ++b)
+			{
+				const int64 Cost = GetMergeCost(DirtyRects[a], DirtyRects[b]);
+				if (Cost < BestCost)
+				{
+					BestCost = Cost;
+					BestA = a;
+					BestB = b;
+				}
+			}
+		}
+
+		DirtyRects[BestA].Union(DirtyRects[BestB]);
+		DirtyRects.RemoveAtSwap(BestB);
+	}
+}
+
+int64 ACanvasArea::GetMergeCost(const FIntRect& A, const FIntRect& B)
+{
+	// Extra pixels uploaded by the union, minus the overhead saved by sending one region instead of two
+	FIntRect Union = A;
+	Union.Union(B);
+
+	const int64 UnionArea = (int64)Union.Width() * Union.Height();
+	const int64 SeparateArea = (int64)A.Width() * A.Height() + (int64)B.Width() * B.Height();
+	
+	return UnionArea - SeparateArea - DirtyRectOverheadPixels;
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
 {
-	*Pointer = Blue;			// b
-	*(Pointer + 1) = Green;		// g
-	*(Pointer + 2) = Red;		// r
-	*(Pointer + 3) = Alpha;		// a
+	// Redraws the same paintings serially and in parallel bands, on every storage, pixel format and edge mode
+	void RunRasterizePaintingBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		const FString NdjsonPath = Args.Num() > 0 ? Args[0] : FPaths::ProjectContentDir() / TEXT("PaintingHistory/Painting_0.ndjson");
+		const int32 Iterations = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 20;
+		const int32 BrushRadius = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 10;
+
+		TArray<FString> Lines;
+		TArray<FPainting> Paintings;
+		if (World == nullptr || !FFileHelper::LoadFileToStringArray(Lines, *NdjsonPath))
+			return;
+
+		for (const FString& Line : Lines)
+		{
+			FPaintingHeader Header;
+			FPainting Painting;
+			if (FPaintingBinaryFormat::ParseNdjsonLine(Line, Header, Painting))
+				Paintings.Add(MoveTemp(Painting));
+		}
+
+		if (Paintings.Num() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[ACanvasArea] No paintings found in %s"), *NdjsonPath);
+			return;
+		}
+
+		const int32 NumWorkers = FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads(), 1);
+		UE_LOG(LogTemp, Display, TEXT("[ACanvasArea] %d paintings, brush radius %d, %d iterations, %d workers"), Paintings.Num(), BrushRadius, Iterations, NumWorkers);
+
+		int32 NumMismatches = 0;
+		TArray<uint8> SerialPixels, ParallelPixels;
+		for (const bool bTiled : { false, true })
+		{
+			for (const ECanvasPixelFormat Format : { ECanvasPixelFormat::Color, ECanvasPixelFormat::Coverage8 })
+			{
+				for (const bool bAntiAliased : { false, true })
+				{
+					// Set up before BeginPlay, which initializes the canvas
+					FActorSpawnParameters SpawnParameters;
+					SpawnParameters.bDeferConstruction = true;
+					SpawnParameters.ObjectFlags |= RF_Transient;
+					ACanvasArea* Canvas = World->SpawnActor<ACanvasArea>(SpawnParameters);
+					if (Canvas == nullptr)
+						return;
+
+					Canvas->CanvasPixelFormat = Format;
+					Canvas->bUseTiledStorage = bTiled;
+					Canvas->bAntiAliasedStrokes = bAntiAliased;
+					Canvas->bDeferCanvasUpload = true;
+					Canvas->bSampleEveryCursorMove = false;
+					Canvas->StartBrushRadius = BrushRadius;
+					Canvas->FinishSpawning(FTransform::Identity);
+
+					// Outside of play, nothing initialized it
+					if (!Canvas->HasActorBegunPlay())
+					{
+						Canvas->InitializeCanvas(Canvas->StartWidth, Canvas->StartHeight);
+						Canvas->InitializeDrawingTools(BrushRadius);
+					}
+
+					bool bIdentical = true;
+					double SerialSeconds = 0.0, ParallelSeconds = 0.0;
+					for (const FPainting& Painting : Paintings)
+					{
+						for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+						{
+							const double SerialStart = FPlatformTime::Seconds();
+							Canvas->RasterizePainting(Painting, true);
+							SerialSeconds += FPlatformTime::Seconds() - SerialStart;
+						}
+						Canvas->CopyPixels(SerialPixels);
+
+						for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+						{
+							const double ParallelStart = FPlatformTime::Seconds();
+							Canvas->RasterizePainting(Painting, false);
+							ParallelSeconds += FPlatformTime::Seconds() - ParallelStart;
+						}
+						Canvas->CopyPixels(ParallelPixels);
+
+						bIdentical &= SerialPixels.Num() == ParallelPixels.Num() && FMemory::Memcmp(SerialPixels.GetData(), ParallelPixels.GetData(), SerialPixels.Num()) == 0;
+					}
+
+					NumMismatches += bIdentical ? 0 : 1;
+
+					const int32 NumRedraws = Paintings.Num() * Iterations;
+					UE_LOG(LogTemp, Display, TEXT("[ACanvasArea] %s %s, AA %s: serial %.3f ms, parallel %.3f ms, x%.2f on %d workers, %s"),
+						bTiled ? TEXT("Tiled") : TEXT("Dense"), Format == ECanvasPixelFormat::Color ? TEXT("Color") : TEXT("Coverage8"), bAntiAliased ? TEXT("on") : TEXT("off"),
+						SerialSeconds * 1000.0 / NumRedraws, ParallelSeconds * 1000.0 / NumRedraws, SerialSeconds / FMath::Max(ParallelSeconds, 1e-9), NumWorkers,
+						bIdentical ? TEXT("identical") : TEXT("DIFFERENT"));
+
+					// The transient texture is rooted by InitializeCanvas
+					if (Canvas->DynamicCanvas != nullptr)
+						Canvas->DynamicCanvas->RemoveFromRoot();
+					Canvas->Destroy();
+				}
+			}
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("[ACanvasArea] Serial and parallel redraws: %s, %d of 8 configurations differ"),
+			NumMismatches == 0 ? TEXT("passed") : TEXT("FAILED"), NumMismatches);
+	}
+
+	FAutoConsoleCommandWithWorldAndArgs BenchmarkRasterizePaintingCommand(
+		TEXT("SpeedArtist.Benchmark.RasterizePainting"),
+		TEXT("Redraws paintings serially and in parallel on every canvas configuration, checks the pixels match and times both. Args: [NdjsonPath] [Iterations] [BrushRadius]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunRasterizePaintingBenchmark));
 }
 
+#endif
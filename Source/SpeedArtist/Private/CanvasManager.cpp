@@ -4,59 +4,38 @@
 #include "CanvasManager.h"
 
 #include "CanvasArea.h"
+#include "Async/Async.h"
 #include "Blueprint/UserWidget.h"
 #include "Characters/PlayerCharacter.h"
 #include "Kismet/GameplayStatics.h"
 #include "Widgets/MainCanvasWidget.h"
 
-// Thanks to: https://forums.unrealengine.com/t/multithreading-and-performance-in-unreal/1216417
-FRunOutputThroughModel::FRunOutputThroughModel(FString FullFilePath, UCanvasManager* CanvasManagerRef)
+namespace
 {
-	Thread = FRunnableThread::Create(this, TEXT("Model runner"));
-	FilePath = FullFilePath;
-	CanvasManager = CanvasManagerRef;
-}
+	// "name 62%" for the Count most likely classes
+	TArray<FString> MakeLiveGuesses(const TArray<FString>& Classes, const TArray<float>& Logits, const int32 Count)
+	{
+		float MaxLogit = Logits[0];
+		for (const float Logit : Logits)
+			MaxLogit = FMath::Max(MaxLogit, Logit);
 
-bool FRunOutputThroughModel::Init()
-{
-	return true;
-}
+		TArray<float> Probabilities;
+		float Total = 0.0f;
+		for (const float Logit : Logits)
+			Total += Probabilities.Add_GetRef(FMath::Exp(Logit - MaxLogit));
 
-uint32 FRunOutputThroughModel::Run()
-{
-	UE_LOG(LogTemp, Display, TEXT("[FRunOutputThroughModel] Running the painting through the RNN model..."));
-	
-	FString Cmd = TEXT("C:\\Users\\mihne\\anaconda3\\envs\\SpeedArtist-PyTorch\\python.exe");
-	FString Params = FString("PaintingRater.py \"").Append(FilePath).Append("\"");
-	FString WorkingDir = TEXT("G:\\Python\\SpeedArtist-PyTorch");
-	uint32 ProcId = 0;
-
-	// void* ReadPipe = nullptr;
-	// void* WritePipe = nullptr;
-	// FWindowsPlatformProcess::CreatePipe(ReadPipe, WritePipe);
-	// FProcHandle ProcHandle = FWindowsPlatformProcess::CreateProc(*Cmd, *Params, true, false, false, &ProcId,  0, *WorkingDir, nullptr);
-
-	int32 ReturnCode = 0;
-	FString ProcStdout;
-	FString ProcStderr;
-	bool ExecProcessResult = FWindowsPlatformProcess::ExecProcess(*Cmd, *Params, &ReturnCode, &ProcStdout, &ProcStderr, *WorkingDir);
-	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] Exec process result: %d"), ExecProcessResult);
-	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] Exec process stdout: %s"), *ProcStdout);
-	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] Exec process stderr: %s"), *ProcStderr);
-	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] Exec process return code: %d"), ReturnCode);
-
-	// Setup variables for next tick
-	CanvasManager->ReceivedNewEvaluationResult = true;
-	CanvasManager->ResponseCode = ReturnCode;
-	CanvasManager->StandardOutput = ProcStdout;
-	CanvasManager->StandardError = ProcStderr;
-	
-	return 0;
-}
+		TArray<int32> Order;
+		for (int32 c = 0; c < FMath::Min(Logits.Num(), Classes.Num()); ++c)
+			Order.Add(c);
 
-void FRunOutputThroughModel::Stop()
-{
-	
+		Order.Sort([&Logits](const int32 A, const int32 B) { return Logits[A] > Logits[B]; });
+
+		TArray<FString> Guesses;
+		for (int32 i = 0; i < FMath::Min(Count, Order.Num()); ++i)
+			Guesses.Add(FString::Printf(TEXT("%s %d%%"), *Classes[Order[i]], FMath::RoundToInt(100.0f * Probabilities[Order[i]] / Total)));
+
+		return Guesses;
+	}
 }
 
 // Sets default values for this component's properties
@@ -84,10 +63,50 @@ void UCanvasManager::BeginPlay()
 
 	PlayerCharacter->OnConfirm.AddDynamic(this, &UCanvasManager::HandleOnConfirm);
 	PlayerCharacter->OnReset.AddDynamic(this, &UCanvasManager::HandleOnReset);
+	PlayerCharacter->OnUndo.AddDynamic(this, &UCanvasManager::HandleOnUndo);
+	PlayerCharacter->OnRedo.AddDynamic(this, &UCanvasManager::HandleOnRedo);
 	
 	PlayerCharacter->OnStartDrawing.AddDynamic(this, &UCanvasManager::HandleOnStartDrawing);
 	PlayerCharacter->OnDraw.AddDynamic(this, &UCanvasManager::HandleOnDraw);
 	PlayerCharacter->OnStopDrawing.AddDynamic(this, &UCanvasManager::HandleOnStopDrawing);
+
+	const FString HistoryDirectory = FPaths::ProjectContentDir() / TEXT("PaintingHistory");
+	HistoryLog = FPaintingHistoryLog::GetShared(HistoryDirectory, (int64)MaxHistorySegmentMB * 1024 * 1024);
+
+	if (EvaluatorBackend == EEvaluatorBackend::Native)
+	{
+		FQuickDrawBatchSettings BatchSettings;
+		BatchSettings.BatchWindowSeconds = NativeBatchWindowMs / 1000.0f;
+		BatchSettings.MaxBatchSize = NativeMaxBatchSize;
+
+		NativeQueue = FQuickDrawBatchQueue::GetShared(FPaths::ProjectDir() / NativeModelPath, (EQuickDrawPrecision)NativeModelPrecision, BatchSettings);
+		if (NativeQueue.IsValid())
+		{
+			NativeModel = NativeQueue->GetModel();
+			return;
+		}
+
+		UE_LOG(LogTemp, Warning, TEXT("[UCanvasManager] Native model unavailable, using the Python evaluator"));
+	}
+
+	// Start the evaluator now, so the model is loaded by the time the first painting is confirmed
+	FEvaluatorSettings EvaluatorSettings;
+	EvaluatorSettings.Executable = EvaluatorExecutable;
+	EvaluatorSettings.Arguments = bUseStubEvaluator ? TEXT("StubEvaluator.py") : EvaluatorArguments;
+	EvaluatorSettings.WorkingDirectory = EvaluatorWorkingDirectory;
+	Evaluator = MakeUnique<FEvaluatorProcess>(EvaluatorSettings);
+}
+
+// Called when the game ends
+void UCanvasManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// The last canvas using the log waits for the queued paintings to be written
+	HistoryLog.Reset();
+	Evaluator.Reset();
+	NativeQueue.Reset();
+	NativeModel.Reset();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // void UCanvasManager::StartGame()
@@ -117,8 +136,21 @@ void UCanvasManager::BeginRound()
 	MainCanvasWidget->SetObjectToDraw(CurrentClass);
 	
 	CanvasArea->ClearCanvas();
+	RoundStartTime = FDateTime::UtcNow();
 	
 	MainCanvasWidget->ResetPrediction();
+
+	// Live guesses still running for the previous round are dropped
+	++LiveRound;
+	LiveStream.Reset();
+	if (bLivePrediction && NativeModel.IsValid())
+		LiveStream = MakeShared<FQuickDrawStream, ESPMode::ThreadSafe>(NativeModel.ToSharedRef(), LiveBackwardWindow);
+
+	LivePaintingRevision = CanvasArea->GetPaintingRevision();
+	LiveFinishedStrokes = 0;
+	LiveOpenPoints = 0;
+	LiveOpenStrokeStart = 0;
+	LiveStablePoints = 0;
 }
 
 void UCanvasManager::EndRound()
@@ -132,7 +164,8 @@ void UCanvasManager::TickComponent(float DeltaTime, ELevelTick TickType, FActorC
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	// ...
+	if (CurrentDrawingState == Drawing && LiveStream.IsValid())
+		UpdateLivePrediction();
 }
 
 void UCanvasManager::HandleOnConfirm(APlayerCharacter* Player)
@@ -163,50 +196,82 @@ void UCanvasManager::HandleOnConfirm(APlayerCharacter* Player)
 		// Get the FPainting from the CanvasArea
 		FPainting& Painting = CanvasArea->GetCurrentPainting();
 	
-		// Simplify each stroke
-		Painting.Simplify(2.0f);
+		// Simplify each stroke, the canvas already did it for the finished ones
+		Painting.Simplify(CanvasArea->StrokeSimplifyEps);
 	
-		// Write the stroke data to a file, along with the class
-		TArray<FString> StrokeData {
-			// Add a test input
-			// "{\"word\":\"axe\",\"drawing\":[[[0,43,62],[59,82,104]],[[2,25,118],[56,39,2]],[[118,118,131,142,73,53],[2,22,83,103,104,101]],[[120,122],[0,9]],[[122,124,153,204,255,252,242,221,207,190,178],[9,60,113,169,213,219,223,205,199,186,173]]]}"
-		};
-
+		// Serialize the stroke data, along with the class
+		// Test input: {"word":"axe","drawing":[[[0,43,62],[59,82,104]],[[2,25,118],[56,39,2]],[[118,118,131,142,73,53],[2,22,83,103,104,101]],[[120,122],[0,9]],[[122,124,153,204,255,252,242,221,207,190,178],[9,60,113,169,213,219,223,205,199,186,173]]]}
+		NdjsonWriter.Reset();
 		if (Painting.Strokes.Num() > 0)
-			StrokeData.Add(CreateModelInputJson(Painting, CurrentClass));
-
-		// Get the path to the file
-		FString FullContentPath = IFileManager::Get().ConvertToAbsolutePathForExternalAppForRead(*FPaths::ProjectContentDir());
-		FString RootPath = FullContentPath.Append("PaintingHistory/");
-		FString FilePath = RootPath.Append("Painting_0.ndjson");
-	
-		FFileHelper::SaveStringArrayToFile(StrokeData, *FilePath);
+			WriteModelInput(Painting, CurrentClass);
+
+		// Keep every painting along with the round details, written out in the background
+		if (HistoryLog.IsValid())
+		{
+			FPaintingHeader Header;
+			Header.Word = CurrentClass;
+			Header.CanvasWidth = CanvasArea->GetCanvasSize().X;
+			Header.CanvasHeight = CanvasArea->GetCanvasSize().Y;
+			Header.StartTime = RoundStartTime;
+			Header.SubmitTime = FDateTime::UtcNow();
+
+			HistoryLog->Append(Header, Painting);
+		}
 	
-		// Start a python process that reads the data, loads the model and predicts the class
-		FRunOutputThroughModel* RunOutputThroughModel = new FRunOutputThroughModel(FilePath, this);
-		RunOutputThroughModel->Init();
-
 		CurrentDrawingState = Evaluating;
 		MainCanvasWidget->StartPrediction();
 
-		GetWorld()->GetTimerManager().SetTimer(CurrentTimerHandle, this, &UCanvasManager::CheckEvaluationDone, 0.5f, true);
+		if (Painting.Strokes.Num() == 0)
+		{
+			ProcessEvaluationResult(FEvaluationResult{ true, TEXT("Empty") });
+			return;
+		}
+
+		if (NativeModel.IsValid())
+		{
+			EvaluateNative(Painting);
+			return;
+		}
+
+		// Hand the painting to the evaluator worker, the answer comes back on the game thread
+		TArray<uint8> Request(NdjsonWriter.GetBytes());
+		Evaluator->Evaluate(MoveTemp(Request), [WeakThis = TWeakObjectPtr<UCanvasManager>(this)](const FEvaluationResult& Result)
+		{
+			if (UCanvasManager* Manager = WeakThis.Get())
+				Manager->ProcessEvaluationResult(Result);
+		});
 	}
 }
 
-void UCanvasManager::CheckEvaluationDone()
+void UCanvasManager::HandleOnReset(APlayerCharacter* Player)
 {
-	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] Evaluating.."));
-	if (ReceivedNewEvaluationResult)
+	if (CanvasArea == nullptr)
 	{
-		ReceivedNewEvaluationResult = false;
+		UE_LOG(LogTemp, Error, TEXT("[UCanvasManager] Canvas Area not found"));
+		return;
+	}
 
-		GetWorld()->GetTimerManager().ClearTimer(CurrentTimerHandle);
-		
-		ProcessEvaluationResult();
+	if (CurrentDrawingState != Drawing)
+		return;
+
+	CanvasArea->ClearCanvas();
+}
+
+void UCanvasManager::HandleOnUndo(APlayerCharacter* Player)
+{
+	if (CanvasArea == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[UCanvasManager] Canvas Area not found"));
+		return;
 	}
+
+	if (CurrentDrawingState != Drawing)
+		return;
+
+	CanvasArea->UndoStroke();
 }
 
-void UCanvasManager::HandleOnReset(APlayerCharacter* Player)
+void UCanvasManager::HandleOnRedo(APlayerCharacter* Player)
 {
 	if (CanvasArea == nullptr)
 	{
@@ -217,7 +282,7 @@ void UCanvasManager::HandleOnReset(APlayerCharacter* Player)
 	if (CurrentDrawingState != Drawing)
 		return;
 
-	CanvasArea->ClearCanvas();
+	CanvasArea->RedoStroke();
 }
 
 void UCanvasManager::HandleOnStartDrawing(APlayerCharacter* Player)
@@ -262,12 +327,12 @@ void UCanvasManager::HandleOnStopDrawing(APlayerCharacter* Player)
 	CanvasArea->StopDrawing();
 }
 
-FString UCanvasManager::CreateModelInputJson(FPainting Painting, FString ClassName)
+void UCanvasManager::WriteModelInput(const FPainting& Painting, const FString& ClassName)
 {
-	const FString ModelInputJson = FString::Format(TEXT("{\"word\":\"{0}\",\"drawing\":{1}}"), { *ClassName, *Painting.Serialize() });
-	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] %s"), *ModelInputJson);
-	
-	return ModelInputJson;
+	NdjsonWriter.WriteLine(Painting, ClassName);
+
+	// Only converted when verbose logging is on
+	UE_LOG(LogTemp, Verbose, TEXT("[UCanvasManager] %s"), *FString(NdjsonWriter.GetBytes().Num(), reinterpret_cast<const UTF8CHAR*>(NdjsonWriter.GetBytes().GetData())));
 }
 
 void UCanvasManager::ChooseRandomClass()
@@ -281,25 +346,115 @@ void UCanvasManager::ChooseRandomClass()
 	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] Object to draw: %s"), *CurrentClass);
 }
 
-void UCanvasManager::ProcessEvaluationResult()
+void UCanvasManager::EvaluateNative(const FPainting& Painting)
+{
+	// Batched with the paintings other canvases confirm around the same time, the answer comes back on the game thread
+	NativeQueue->Evaluate(Painting, [WeakThis = TWeakObjectPtr<UCanvasManager>(this)](const FEvaluationResult& Result)
+	{
+		if (UCanvasManager* Manager = WeakThis.Get())
+			Manager->ProcessEvaluationResult(Result);
+	});
+}
+
+void UCanvasManager::UpdateLivePrediction()
+{
+	const double Now = FPlatformTime::Seconds();
+	if (bLiveUpdateInFlight || CanvasArea == nullptr || Now - LastLiveUpdateTime < LivePredictionInterval)
+		return;
+
+	LastLiveUpdateTime = Now;
+
+	// Undo, redo and clearing change strokes the stream already holds, so it starts over from the first point
+	if (CanvasArea->GetPaintingRevision() != LivePaintingRevision)
+	{
+		LivePaintingRevision = CanvasArea->GetPaintingRevision();
+		LiveFinishedStrokes = 0;
+		LiveOpenPoints = 0;
+		LiveOpenStrokeStart = 0;
+		LiveStablePoints = 0;
+	}
+
+	// Only what the stream does not hold yet is copied: the strokes finished since the previous update and the newly
+	// settled points of the open stroke, all simplified already
+	int32 NumKeptPoints = LiveStablePoints;
+	TArray<float> Points;
+	const TArray<FStroke>& Strokes = CanvasArea->GetCurrentPainting().Strokes;
+	for (; LiveFinishedStrokes < Strokes.Num(); ++LiveFinishedStrokes)
+	{
+		// A finished stroke is simplified whole, which can keep other points than the ones settled while it was drawn,
+		// so the stroke that was open is handed over again from its first point. The stream skips the points that stayed.
+		if (LiveOpenPoints > 0)
+		{
+			NumKeptPoints = LiveOpenStrokeStart;
+			LiveOpenPoints = 0;
+		}
+
+		FQuickDrawModel::AppendStrokePoints(Strokes[LiveFinishedStrokes], Points);
+	}
+
+	// The open stroke's tail is replaced on every update, it is simplified on the worker like FStroke::SimplifyTail does
+	FStroke Tail;
+	bool bTailAnchored = false;
+	if (const FStroke* OpenStroke = CanvasArea->GetStrokeInProgress())
+	{
+		if (LiveOpenPoints == 0)
+			LiveOpenStrokeStart = NumKeptPoints + Points.Num() / FQuickDrawModel::InputChannels;
+
+		FQuickDrawModel::AppendStrokePoints(*OpenStroke, Points, LiveOpenPoints, OpenStroke->NumSettledPoints);
+		LiveOpenPoints = FMath::Max(LiveOpenPoints, OpenStroke->NumSettledPoints);
+
+		bTailAnchored = OpenStroke->NumSettledPoints > 0;
+		for (int32 i = OpenStroke->GetTailStart(); i < OpenStroke->Num(); ++i)
+			Tail.AddPoint(OpenStroke->Xs[i], OpenStroke->Ys[i]);
+	}
+
+	LiveStablePoints = NumKeptPoints + Points.Num() / FQuickDrawModel::InputChannels;
+
+	bLiveUpdateInFlight = true;
+	Async(EAsyncExecution::ThreadPool, [Stream = LiveStream, Model = NativeModel, NumKeptPoints, Points = MoveTemp(Points), Tail = MoveTemp(Tail), bTailAnchored,
+		Eps = CanvasArea->StrokeSimplifyEps, Count = LiveGuessCount, Round = LiveRound, WeakThis = TWeakObjectPtr<UCanvasManager>(this)]() mutable
+	{
+		// The anchor is a settled point the stream already has
+		if (Tail.Num() > 0)
+		{
+			Tail.Simplify(Eps);
+			FQuickDrawModel::AppendStrokePoints(Tail, Points, bTailAnchored ? 1 : 0);
+		}
+
+		TArray<float> Logits;
+		TArray<FString> Guesses;
+		const bool bUpdated = Stream->Update(NumKeptPoints, Points, Logits);
+		if (bUpdated)
+			Guesses = MakeLiveGuesses(Model->GetClasses(), Logits, Count);
+
+		// An empty canvas clears the guesses
+		const bool bShow = bUpdated || Stream->GetNumSteps() == 0;
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Round, bShow, Guesses = MoveTemp(Guesses)]()
+		{
+			UCanvasManager* Manager = WeakThis.Get();
+			if (Manager == nullptr)
+				return;
+
+			Manager->bLiveUpdateInFlight = false;
+			if (bShow && Round == Manager->LiveRound && Manager->CurrentDrawingState == Drawing)
+				Manager->MainCanvasWidget->ShowLiveGuesses(Guesses);
+		});
+	});
+}
+
+void UCanvasManager::ProcessEvaluationResult(const FEvaluationResult& Result)
 {
 	EndRound();
 	
-	if (ResponseCode != 0)
+	if (!Result.bSuccess)
 	{
 		// Display an error
-		UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] AN ERROR OCCURED DURING EVALUATION"));
+		UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] AN ERROR OCCURED DURING EVALUATION: %s"), *Result.Error);
 		
 		return;
 	}
 
-	// Parse the standard output and extract the result
-	TArray<FString> lines;
-	StandardOutput.ParseIntoArrayLines(lines);
+	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] PREDICTED CLASS: %s"), *Result.ClassName);
 
-	FString LastOutputLine = *lines.rbegin();
-	UE_LOG(LogTemp, Display, TEXT("[UCanvasManager] FINAL OUTPUT LINE: %s"), *LastOutputLine);
-
-	MainCanvasWidget->EndPrediction(LastOutputLine);
+	MainCanvasWidget->EndPrediction(Result.ClassName);
 }
-
@@ -91,6 +91,20 @@ void APlayerCharacter::ResetInput(const FInputActionValue& Value)
 	OnReset.Broadcast(this);
 }
 
+void APlayerCharacter::UndoInput(const FInputActionValue& Value)
+{
+	Super::UndoInput(Value);
+
+	OnUndo.Broadcast(this);
+}
+
+void APlayerCharacter::RedoInput(const FInputActionValue& Value)
+{
+	Super::RedoInput(Value);
+
+	OnRedo.Broadcast(this);
+}
+
 void APlayerCharacter::ToggleDrawingMode(const bool bEnterDrawingMode)
 {	
 	PlayerController->bShowMouseCursor = bEnterDrawingMode;
@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/CanvasInputSampler.h"
+
+#include "Engine/GameViewportClient.h"
+#include "Slate/SceneViewport.h"
+
+FCanvasInputSampler::FCanvasInputSampler(UGameViewportClient* InViewportClient)
+	: ViewportClient(InViewportClient)
+{
+}
+
+void FCanvasInputSampler::SetCapturing(const bool bInCapturing)
+{
+	bCapturing = bInCapturing;
+	Samples.Reset();
+}
+
+int32 FCanvasInputSampler::ConsumeSamples(TArray<FCanvasInputSample>& OutSamples)
+{
+	// Swapping keeps both allocations around for the next frames
+	OutSamples.Reset();
+	Swap(OutSamples, Samples);
+	return OutSamples.Num();
+}
+
+bool FCanvasInputSampler::HandleMouseMoveEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent)
+{
+	if (!bCapturing || !ViewportClient.IsValid())
+		return false;
+
+	FSceneViewport* SceneViewport = ViewportClient->GetGameViewport();
+	if (!SceneViewport)
+		return false;
+
+	// Convert from desktop pixels while the viewport geometry matches the event
+	const FVector2D ScreenPosition = MouseEvent.GetScreenSpacePosition();
+	const FVector2D Normalized = SceneViewport->VirtualDesktopPixelToViewport(FIntPoint(FMath::FloorToInt32(ScreenPosition.X), FMath::FloorToInt32(ScreenPosition.Y)));
+	if (Normalized.X < 0.0 || Normalized.Y < 0.0 || Normalized.X > 1.0 || Normalized.Y > 1.0)
+		return false;
+
+	if (Samples.Num() >= MaxSamples)
+		Samples.RemoveAt(0, Samples.Num() / 2, EAllowShrinking::No);
+
+	const FIntPoint ViewportSize = SceneViewport->GetSizeXY();
+	Samples.Add(FCanvasInputSample{ Normalized * FVector2D(ViewportSize), FPlatformTime::Seconds() });
+
+	// Never consume the event, the regular input still has to see it
+	return false;
+}
@@ -0,0 +1,282 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/CanvasPixelKernels.h"
+
+#if PLATFORM_CPU_X86_FAMILY
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX2 intrinsics anywhere, clang and gcc need the functions to be tagged
+#if PLATFORM_CPU_X86_FAMILY && (defined(__clang__) || defined(__GNUC__))
+#define CANVAS_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CANVAS_KERNELS_TARGET_AVX2
+#endif
+
+// Same for _xgetbv under clang-cl, which only runs once CPUID reports OSXSAVE
+#if PLATFORM_CPU_X86_FAMILY && defined(_MSC_VER) && defined(__clang__)
+#define CANVAS_KERNELS_TARGET_XSAVE __attribute__((target("xsave")))
+#else
+#define CANVAS_KERNELS_TARGET_XSAVE
+#endif
+
+namespace
+{
+	using FFillSpanFunc = void(*)(FColor*, int32, FColor);
+	using FBlendSpanFunc = void(*)(FColor*, int32, FColor);
+	using FBlendCoverageSpanFunc = void(*)(uint8*, int32, uint8, uint8);
+
+	struct FKernelTable
+	{
+		FFillSpanFunc FillSpan;
+		FBlendSpanFunc BlendSpan;
+		FBlendCoverageSpanFunc BlendCoverageSpan;
+		const TCHAR* Name;
+	};
+
+	// round(Dst * (255 - Alpha) / 255 + Src * Alpha / 255), shared by every implementation
+	FORCEINLINE uint8 BlendChannel(const uint32 Src, const uint32 Dst, const uint32 Alpha)
+	{
+		const uint32 Value = Dst * (255 - Alpha) + Src * Alpha + 128;
+		return (uint8)((Value + (Value >> 8)) >> 8);
+	}
+
+	void FillSpanScalar(FColor* Dst, const int32 Count, const FColor Color)
+	{
+		for (int32 i = 0; i < Count; ++i)
+			Dst[i] = Color;
+	}
+
+	void BlendSpanScalar(FColor* Dst, const int32 Count, const FColor Color)
+	{
+		const uint32 Alpha = Color.A;
+		for (int32 i = 0; i < Count; ++i)
+		{
+			FColor& Pixel = Dst[i];
+			Pixel.B = BlendChannel(Color.B, Pixel.B, Alpha);
+			Pixel.G = BlendChannel(Color.G, Pixel.G, Alpha);
+			Pixel.R = BlendChannel(Color.R, Pixel.R, Alpha);
+			Pixel.A = BlendChannel(255, Pixel.A, Alpha);
+		}
+	}
+
+	void BlendCoverageSpanScalar(uint8* Dst, const int32 Count, const uint8 Value, const uint8 Alpha)
+	{
+		for (int32 i = 0; i < Count; ++i)
+			Dst[i] = BlendChannel(Value, Dst[i], Alpha);
+	}
+
+#if PLATFORM_CPU_X86_FAMILY
+	// Src * Alpha + 128 for each channel of two pixels, in BGRA lane order (alpha is composited as 255)
+	FORCEINLINE __m128i MakeSourceTerm(const FColor Color)
+	{
+		const uint16 Alpha = Color.A;
+		const int16 B = (int16)(uint16)(Color.B * Alpha + 128);
+		const int16 G = (int16)(uint16)(Color.G * Alpha + 128);
+		const int16 R = (int16)(uint16)(Color.R * Alpha + 128);
+		const int16 A = (int16)(uint16)(255 * Alpha + 128);
+		return _mm_set_epi16(A, R, G, B, A, R, G, B);
+	}
+
+	FORCEINLINE __m128i BlendWords(const __m128i Dst, const __m128i InvAlpha, const __m128i SourceTerm)
+	{
+		const __m128i Value = _mm_add_epi16(_mm_mullo_epi16(Dst, InvAlpha), SourceTerm);
+		return _mm_srli_epi16(_mm_add_epi16(Value, _mm_srli_epi16(Value, 8)), 8);
+	}
+
+	void FillSpanSSE2(FColor* Dst, const int32 Count, const FColor Color)
+	{
+		const __m128i Value = _mm_set1_epi32((int32)Color.DWColor());
+		int32 i = 0;
+		for (; i + 4 <= Count; i += 4)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i), Value);
+
+		FillSpanScalar(Dst + i, Count - i, Color);
+	}
+
+	void BlendSpanSSE2(FColor* Dst, const int32 Count, const FColor Color)
+	{
+		const __m128i Zero = _mm_setzero_si128();
+		const __m128i InvAlpha = _mm_set1_epi16((int16)(255 - Color.A));
+		const __m128i SourceTerm = MakeSourceTerm(Color);
+
+		int32 i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			__m128i* Ptr = reinterpret_cast<__m128i*>(Dst + i);
+			const __m128i Pixels = _mm_loadu_si128(Ptr);
+			const __m128i Lo = BlendWords(_mm_unpacklo_epi8(Pixels, Zero), InvAlpha, SourceTerm);
+			const __m128i Hi = BlendWords(_mm_unpackhi_epi8(Pixels, Zero), InvAlpha, SourceTerm);
+			_mm_storeu_si128(Ptr, _mm_packus_epi16(Lo, Hi));
+		}
+
+		BlendSpanScalar(Dst + i, Count - i, Color);
+	}
+
+	void BlendCoverageSpanSSE2(uint8* Dst, const int32 Count, const uint8 Value, const uint8 Alpha)
+	{
+		const __m128i Zero = _mm_setzero_si128();
+		const __m128i InvAlpha = _mm_set1_epi16((int16)(255 - Alpha));
+		const __m128i SourceTerm = _mm_set1_epi16((int16)(uint16)(Value * Alpha + 128));
+
+		int32 i = 0;
+		for (; i + 16 <= Count; i += 16)
+		{
+			__m128i* Ptr = reinterpret_cast<__m128i*>(Dst + i);
+			const __m128i Pixels = _mm_loadu_si128(Ptr);
+			const __m128i Lo = BlendWords(_mm_unpacklo_epi8(Pixels, Zero), InvAlpha, SourceTerm);
+			const __m128i Hi = BlendWords(_mm_unpackhi_epi8(Pixels, Zero), InvAlpha, SourceTerm);
+			_mm_storeu_si128(Ptr, _mm_packus_epi16(Lo, Hi));
+		}
+
+		BlendCoverageSpanScalar(Dst + i, Count - i, Value, Alpha);
+	}
+
+	CANVAS_KERNELS_TARGET_AVX2 void FillSpanAVX2(FColor* Dst, const int32 Count, const FColor Color)
+	{
+		const __m256i Value = _mm256_set1_epi32((int32)Color.DWColor());
+		int32 i = 0;
+		for (; i + 8 <= Count; i += 8)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(Dst + i), Value);
+
+		FillSpanScalar(Dst + i, Count - i, Color);
+	}
+
+	CANVAS_KERNELS_TARGET_AVX2 void BlendSpanAVX2(FColor* Dst, const int32 Count, const FColor Color)
+	{
+		const __m256i Zero = _mm256_setzero_si256();
+		const __m256i InvAlpha = _mm256_set1_epi16((int16)(255 - Color.A));
+		const __m256i SourceTerm = _mm256_broadcastsi128_si256(MakeSourceTerm(Color));
+
+		// Unpacking and packing both work per 128-bit lane, so the pixel order is preserved
+		int32 i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			__m256i* Ptr = reinterpret_cast<__m256i*>(Dst + i);
+			const __m256i Pixels = _mm256_loadu_si256(Ptr);
+
+			__m256i Lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(Pixels, Zero), InvAlpha), SourceTerm);
+			__m256i Hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(Pixels, Zero), InvAlpha), SourceTerm);
+			Lo = _mm256_srli_epi16(_mm256_add_epi16(Lo, _mm256_srli_epi16(Lo, 8)), 8);
+			Hi = _mm256_srli_epi16(_mm256_add_epi16(Hi, _mm256_srli_epi16(Hi, 8)), 8);
+
+			_mm256_storeu_si256(Ptr, _mm256_packus_epi16(Lo, Hi));
+		}
+
+		BlendSpanSSE2(Dst + i, Count - i, Color);
+	}
+#endif
+
+	CANVAS_KERNELS_TARGET_XSAVE bool CpuSupportsAVX2()
+	{
+#if PLATFORM_CPU_X86_FAMILY
+#if defined(_MSC_VER)
+		// clang-cl included: __builtin_cpu_supports needs compiler-rt, which is not linked against the MSVC runtime
+		int Info[4];
+		__cpuid(Info, 0);
+		if (Info[0] < 7)
+			return false;
+
+		// The OS has to save the YMM registers as well
+		__cpuid(Info, 1);
+		const bool bHasOSXSave = (Info[2] & (1 << 27)) != 0;
+		const bool bHasAVX = (Info[2] & (1 << 28)) != 0;
+		if (!bHasOSXSave || !bHasAVX || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(Info, 7, 0);
+		return (Info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+#else
+		return false;
+#endif
+	}
+
+	FKernelTable SelectKernels()
+	{
+#if PLATFORM_CPU_X86_FAMILY
+		if (CpuSupportsAVX2())
+			return { &FillSpanAVX2, &BlendSpanAVX2, &BlendCoverageSpanSSE2, TEXT("AVX2") };
+
+		// SSE2 is part of the x64 baseline
+		return { &FillSpanSSE2, &BlendSpanSSE2, &BlendCoverageSpanSSE2, TEXT("SSE2") };
+#else
+		return { &FillSpanScalar, &BlendSpanScalar, &BlendCoverageSpanScalar, TEXT("Scalar") };
+#endif
+	}
+
+	const FKernelTable& GetKernels()
+	{
+		static const FKernelTable Kernels = SelectKernels();
+		return Kernels;
+	}
+}
+
+void FCanvasPixelKernels::FillSpan(FColor* Dst, const int32 Count, const FColor Color)
+{
+	if (Count > 0)
+		GetKernels().FillSpan(Dst, Count, Color);
+}
+
+void FCanvasPixelKernels::FillRect(FColor* Dst, const int32 Width, const int32 Height, const int32 PitchPixels, const FColor Color)
+{
+	if (Width <= 0 || Height <= 0)
+		return;
+
+	// Contiguous rows can be filled in one go
+	if (Width == PitchPixels)
+	{
+		GetKernels().FillSpan(Dst, Width * Height, Color);
+		return;
+	}
+
+	for (int32 y = 0; y < Height; ++y)
+		GetKernels().FillSpan(Dst + y * PitchPixels, Width, Color);
+}
+
+void FCanvasPixelKernels::BlendSpan(FColor* Dst, const int32 Count, const FColor Color)
+{
+	if (Count <= 0 || Color.A == 0)
+		return;
+
+	// Fully opaque blending is a plain fill
+	if (Color.A == 255)
+	{
+		GetKernels().FillSpan(Dst, Count, Color);
+		return;
+	}
+
+	GetKernels().BlendSpan(Dst, Count, Color);
+}
+
+void FCanvasPixelKernels::FillCoverageSpan(uint8* Dst, const int32 Count, const uint8 Value)
+{
+	// Memset is already vectorized by the platform
+	if (Count > 0)
+		FMemory::Memset(Dst, Value, Count);
+}
+
+void FCanvasPixelKernels::BlendCoverageSpan(uint8* Dst, const int32 Count, const uint8 Value, const uint8 Alpha)
+{
+	if (Count <= 0 || Alpha == 0)
+		return;
+
+	if (Alpha == 255)
+	{
+		FMemory::Memset(Dst, Value, Count);
+		return;
+	}
+
+	GetKernels().BlendCoverageSpan(Dst, Count, Value, Alpha);
+}
+
+const TCHAR* FCanvasPixelKernels::GetImplementationName()
+{
+	return GetKernels().Name;
+}
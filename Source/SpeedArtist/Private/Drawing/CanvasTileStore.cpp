@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/CanvasTileStore.h"
+
+void FCanvasTileStore::Initialize(const int32 InWidth, const int32 InHeight, const int32 InBytesPerPixel, const uint8* PaperPixel)
+{
+	Width = InWidth;
+	Height = InHeight;
+	BytesPerPixel = InBytesPerPixel;
+	TileCountX = FMath::DivideAndRoundUp(Width, TileSize);
+	TileCountY = FMath::DivideAndRoundUp(Height, TileSize);
+
+	Tiles.Reset();
+	Tiles.SetNum(TileCountX * TileCountY);
+	AllocatedTileCount = 0;
+
+	FillBlankTile(PaperPixel);
+}
+
+void FCanvasTileStore::Clear(const uint8* PaperPixel)
+{
+	for (std::unique_ptr<uint8[]>& Tile : Tiles)
+		Tile.reset();
+	
+	AllocatedTileCount = 0;
+
+	FillBlankTile(PaperPixel);
+}
+
+bool FCanvasTileStore::IsTileAllocated(const int32 TileX, const int32 TileY) const
+{
+	return Tiles[TileX + TileY * TileCountX] != nullptr;
+}
+
+void FCanvasTileStore::CopyTile(const int32 TileIndex, TArray<uint8>& OutPixels) const
+{
+	const std::unique_ptr<uint8[]>& Tile = Tiles[TileIndex];
+	if (!Tile)
+	{
+		OutPixels.Reset();
+		return;
+	}
+
+	OutPixels.SetNumUninitialized(TileSize * GetTilePitch());
+	FMemory::Memcpy(OutPixels.GetData(), Tile.get(), OutPixels.Num());
+}
+
+void FCanvasTileStore::RestoreTile(const int32 TileIndex, const TArray<uint8>& Pixels)
+{
+	std::unique_ptr<uint8[]>& Tile = Tiles[TileIndex];
+	if (Pixels.Num() == 0)
+	{
+		if (Tile)
+		{
+			Tile.reset();
+			--AllocatedTileCount;
+		}
+		return;
+	}
+
+	if (!Tile)
+	{
+		Tile = std::unique_ptr<uint8[]>(new uint8[TileSize * GetTilePitch()]);
+		++AllocatedTileCount;
+	}
+
+	FMemory::Memcpy(Tile.get(), Pixels.GetData(), TileSize * GetTilePitch());
+}
+
+uint8* FCanvasTileStore::GetMutablePixel(const int32 X, const int32 Y)
+{
+	std::unique_ptr<uint8[]>& Tile = Tiles[X / TileSize + (Y / TileSize) * TileCountX];
+	if (!Tile)
+	{
+		// First write to this tile, start from the blank contents
+		Tile = std::unique_ptr<uint8[]>(new uint8[BlankTile->Num()]);
+		FMemory::Memcpy(Tile.get(), BlankTile->GetData(), BlankTile->Num());
+		++AllocatedTileCount;
+	}
+
+	return Tile.get() + (Y % TileSize) * GetTilePitch() + (X % TileSize) * BytesPerPixel;
+}
+
+const uint8* FCanvasTileStore::GetPixel(const int32 X, const int32 Y) const
+{
+	const std::unique_ptr<uint8[]>& Tile = Tiles[X / TileSize + (Y / TileSize) * TileCountX];
+	const uint8* TileData = Tile ? Tile.get() : BlankTile->GetData();
+	
+	return TileData + (Y % TileSize) * GetTilePitch() + (X % TileSize) * BytesPerPixel;
+}
+
+int64 FCanvasTileStore::GetAllocatedBytes() const
+{
+	return (int64)(AllocatedTileCount + 1) * TileSize * GetTilePitch();
+}
+
+void FCanvasTileStore::FillBlankTile(const uint8* PaperPixel)
+{
+	// A new array every time, the previous one may still be read by the render thread
+	BlankTile = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>();
+	BlankTile->SetNumUninitialized(TileSize * GetTilePitch());
+	
+	for (int32 i = 0; i < TileSize * TileSize; ++i)
+		FMemory::Memcpy(BlankTile->GetData() + i * BytesPerPixel, PaperPixel, BytesPerPixel);
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/CanvasUploadRing.h"
+
+FCanvasUploadRing::FCanvasUploadRing(const int32 NumSlots)
+{
+	for (int32 i = 0; i < FMath::Max(NumSlots, 1); ++i)
+		Slots.Add(std::make_unique<FSlot>());
+}
+
+int32 FCanvasUploadRing::AcquireSlot(const int32 NumBytes)
+{
+	for (int32 i = 0; i < Slots.Num(); ++i)
+	{
+		const int32 Slot = (NextSlot + i) % Slots.Num();
+		FSlot& Candidate = *Slots[Slot];
+		if (Candidate.bInFlight.load(std::memory_order_acquire))
+			continue;
+
+		// Slots only grow, so they settle on the size of the largest upload
+		if (Candidate.Data.Num() < NumBytes)
+			Candidate.Data.SetNumUninitialized(NumBytes);
+		
+		Candidate.bInFlight.store(true, std::memory_order_relaxed);
+		NextSlot = (Slot + 1) % Slots.Num();
+		
+		return Slot;
+	}
+
+	return INDEX_NONE;
+}
+
+uint8* FCanvasUploadRing::GetSlotData(const int32 Slot)
+{
+	return Slots[Slot]->Data.GetData();
+}
+
+void FCanvasUploadRing::ReleaseSlot(const int32 Slot)
+{
+	Slots[Slot]->bInFlight.store(false, std::memory_order_release);
+}
@@ -0,0 +1,429 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/PaintingBinaryFormat.h"
+
+#include "CanvasArea.h"
+#include "Async/MappedFileHandle.h"
+#include "Drawing/PaintingNdjsonWriter.h"
+#include "Dom/JsonObject.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	void WriteVarint(TArray<uint8>& Out, uint64 Value)
+	{
+		while (Value >= 0x80)
+		{
+			Out.Add((uint8)(Value | 0x80));
+			Value >>= 7;
+		}
+		Out.Add((uint8)Value);
+	}
+
+	void WriteSignedVarint(TArray<uint8>& Out, const int64 Value)
+	{
+		// Zigzag, so small negative deltas stay small
+		WriteVarint(Out, ((uint64)Value << 1) ^ (uint64)(Value >> 63));
+	}
+
+	template <typename T>
+	void WriteFixed(TArray<uint8>& Out, const T Value)
+	{
+		// The supported platforms are all little endian
+		Out.Append(reinterpret_cast<const uint8*>(&Value), sizeof(T));
+	}
+
+	template <typename T>
+	void PatchFixed(TArray<uint8>& Out, const int64 Offset, const T Value)
+	{
+		FMemory::Memcpy(Out.GetData() + Offset, &Value, sizeof(T));
+	}
+
+	// Bounds checked cursor over a record
+	struct FRecordCursor
+	{
+		const uint8* Ptr;
+		const uint8* End;
+
+		bool ReadVarint(uint64& OutValue)
+		{
+			OutValue = 0;
+			for (int32 Shift = 0; Shift < 64; Shift += 7)
+			{
+				if (Ptr >= End)
+					return false;
+
+				const uint8 Byte = *Ptr++;
+				OutValue |= (uint64)(Byte & 0x7F) << Shift;
+				if ((Byte & 0x80) == 0)
+					return true;
+			}
+			return false;
+		}
+
+		bool ReadSignedVarint(int64& OutValue)
+		{
+			uint64 Value;
+			if (!ReadVarint(Value))
+				return false;
+
+			OutValue = (int64)(Value >> 1) ^ -(int64)(Value & 1);
+			return true;
+		}
+
+		template <typename T>
+		bool ReadFixed(T& OutValue)
+		{
+			if (End - Ptr < (int64)sizeof(T))
+				return false;
+
+			FMemory::Memcpy(&OutValue, Ptr, sizeof(T));
+			Ptr += sizeof(T);
+			return true;
+		}
+
+		const uint8* ReadBytes(const int64 NumBytes)
+		{
+			if (NumBytes < 0 || End - Ptr < NumBytes)
+				return nullptr;
+
+			const uint8* Bytes = Ptr;
+			Ptr += NumBytes;
+			return Bytes;
+		}
+	};
+}
+
+void FPaintingBinaryFormat::Write(const FPaintingHeader& Header, const FPainting& Painting, TArray<uint8>& Out)
+{
+	const int64 RecordStart = Out.Num();
+	WriteFixed<uint32>(Out, Magic);
+	WriteFixed<uint16>(Out, Version);
+	WriteFixed<uint16>(Out, 0);
+	WriteFixed<uint32>(Out, 0);
+
+	WriteVarint(Out, (uint64)FMath::Max(Header.CanvasWidth, 0));
+	WriteVarint(Out, (uint64)FMath::Max(Header.CanvasHeight, 0));
+	WriteFixed<int64>(Out, Header.StartTime.GetTicks());
+	WriteFixed<int64>(Out, Header.SubmitTime.GetTicks());
+
+	const FTCHARToUTF8 Word(*Header.Word);
+	WriteVarint(Out, (uint64)Word.Length());
+	Out.Append(reinterpret_cast<const uint8*>(Word.Get()), Word.Length());
+
+	WriteVarint(Out, (uint64)Painting.Strokes.Num());
+	for (const FStroke& Stroke : Painting.Strokes)
+	{
+		const int32 NumPoints = Stroke.Num();
+		WriteVarint(Out, (uint64)NumPoints);
+		WriteFixed<float>(Out, Stroke.SimplifiedEps);
+
+		int32 PrevX = 0, PrevY = 0;
+		for (int32 i = 0; i < NumPoints; ++i)
+		{
+			WriteSignedVarint(Out, Stroke.Xs[i] - PrevX);
+			WriteSignedVarint(Out, Stroke.Ys[i] - PrevY);
+			WriteVarint(Out, Stroke.TimeDeltas[i]);
+			PrevX = Stroke.Xs[i];
+			PrevY = Stroke.Ys[i];
+		}
+
+		const int64 FlagsStart = Out.Num();
+		Out.AddZeroed((NumPoints + 7) / 8);
+		for (int32 i = 0; i < NumPoints; ++i)
+		{
+			if (Stroke.IsKept(i))
+				Out[FlagsStart + i / 8] |= (uint8)(1 << (i % 8));
+		}
+	}
+
+	PatchFixed<uint32>(Out, RecordStart + 8, (uint32)(Out.Num() - RecordStart - RecordHeaderSize));
+}
+
+bool FPaintingBinaryFormat::Read(TArrayView64<const uint8> Bytes, int64& Offset, FPaintingHeader& OutHeader, FPainting& OutPainting)
+{
+	OutHeader = FPaintingHeader{};
+	OutPainting = FPainting{};
+
+	FRecordCursor Record{ Bytes.GetData() + Offset, Bytes.GetData() + Bytes.Num() };
+	uint32 RecordMagic = 0, PayloadSize = 0;
+	uint16 RecordVersion = 0, Reserved = 0;
+	if (!Record.ReadFixed(RecordMagic) || !Record.ReadFixed(RecordVersion) || !Record.ReadFixed(Reserved) || !Record.ReadFixed(PayloadSize))
+		return false;
+
+	if (RecordMagic != Magic)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FPaintingBinaryFormat] Not a painting record at offset %lld"), Offset);
+		return false;
+	}
+
+	FRecordCursor Payload{ Record.Ptr, Record.Ptr };
+	if (!Record.ReadBytes(PayloadSize))
+		return false;
+	Payload.End = Record.Ptr;
+
+	if (RecordVersion > Version)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[FPaintingBinaryFormat] Skipping a version %d record, this build reads up to version %d"), RecordVersion, Version);
+		Offset = Record.Ptr - Bytes.GetData();
+		return false;
+	}
+
+	uint64 CanvasWidth, CanvasHeight, WordLength, NumStrokes;
+	int64 StartTicks, SubmitTicks;
+	if (!Payload.ReadVarint(CanvasWidth) || !Payload.ReadVarint(CanvasHeight) || !Payload.ReadFixed(StartTicks) || !Payload.ReadFixed(SubmitTicks) || !Payload.ReadVarint(WordLength))
+		return false;
+
+	const uint8* Word = Payload.ReadBytes((int64)WordLength);
+	if (!Word || !Payload.ReadVarint(NumStrokes))
+		return false;
+
+	OutHeader.CanvasWidth = (int32)CanvasWidth;
+	OutHeader.CanvasHeight = (int32)CanvasHeight;
+	OutHeader.StartTime = FDateTime(StartTicks);
+	OutHeader.SubmitTime = FDateTime(SubmitTicks);
+	OutHeader.Word = FString((int32)WordLength, reinterpret_cast<const UTF8CHAR*>(Word));
+
+	OutPainting.Strokes.Reserve((int32)FMath::Min<uint64>(NumStrokes, PayloadSize));
+	for (uint64 StrokeIndex = 0; StrokeIndex < NumStrokes; ++StrokeIndex)
+	{
+		uint64 NumPoints;
+		float SimplifiedEps;
+		if (!Payload.ReadVarint(NumPoints) || !Payload.ReadFixed(SimplifiedEps) || NumPoints > PayloadSize)
+			return false;
+
+		FStroke Stroke;
+		Stroke.Xs.Reserve((int32)NumPoints);
+		Stroke.Ys.Reserve((int32)NumPoints);
+		Stroke.TimeDeltas.Reserve((int32)NumPoints);
+
+		int64 X = 0, Y = 0;
+		for (uint64 i = 0; i < NumPoints; ++i)
+		{
+			int64 Dx, Dy;
+			uint64 TimeDelta;
+			if (!Payload.ReadSignedVarint(Dx) || !Payload.ReadSignedVarint(Dy) || !Payload.ReadVarint(TimeDelta))
+				return false;
+
+			X += Dx;
+			Y += Dy;
+			Stroke.AddPoint((int32)X, (int32)Y, (uint32)TimeDelta);
+		}
+
+		const uint8* Flags = Payload.ReadBytes((int64)(NumPoints + 7) / 8);
+		if (!Flags)
+			return false;
+
+		for (int32 i = 0; i < (int32)NumPoints; ++i)
+			Stroke.KeepFlags[i] = (Flags[i / 8] >> (i % 8)) & 1;
+
+		// Empty strokes are kept, so a painting reads back exactly as it was written
+		Stroke.SimplifiedEps = SimplifiedEps;
+		OutPainting.Strokes.Add(MoveTemp(Stroke));
+	}
+
+	Offset = Record.Ptr - Bytes.GetData();
+	return true;
+}
+
+bool FPaintingBinaryFormat::ParseNdjsonLine(const FString& Line, FPaintingHeader& OutHeader, FPainting& OutPainting)
+{
+	TSharedPtr<FJsonObject> Object;
+	if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Line), Object) || !Object.IsValid())
+		return false;
+
+	const TArray<TSharedPtr<FJsonValue>>* Drawing = nullptr;
+	if (!Object->TryGetStringField(TEXT("word"), OutHeader.Word) || !Object->TryGetArrayField(TEXT("drawing"), Drawing))
+		return false;
+
+	for (const TSharedPtr<FJsonValue>& StrokeValue : *Drawing)
+	{
+		const TArray<TSharedPtr<FJsonValue>>& Axes = StrokeValue->AsArray();
+		if (Axes.Num() < 2)
+			return false;
+
+		const TArray<TSharedPtr<FJsonValue>>& Xs = Axes[0]->AsArray();
+		const TArray<TSharedPtr<FJsonValue>>& Ys = Axes[1]->AsArray();
+		if (Xs.Num() != Ys.Num())
+			return false;
+
+		// Not through FPainting::AddStroke, which drops empty strokes, so both conversions keep them
+		FStroke& Stroke = OutPainting.Strokes.AddDefaulted_GetRef();
+		for (int32 i = 0; i < Xs.Num(); ++i)
+			Stroke.AddPoint((int32)Xs[i]->AsNumber(), (int32)Ys[i]->AsNumber());
+	}
+
+	return true;
+}
+
+bool FPaintingBinaryFormat::ConvertNdjsonToBinary(const TCHAR* NdjsonPath, const TCHAR* BinaryPath)
+{
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, NdjsonPath))
+		return false;
+
+	TArray<uint8> Bytes;
+	for (const FString& Line : Lines)
+	{
+		FPaintingHeader Header;
+		FPainting Painting;
+		if (!ParseNdjsonLine(Line, Header, Painting))
+		{
+			UE_LOG(LogTemp, Error, TEXT("[FPaintingBinaryFormat] Invalid painting in %s"), NdjsonPath);
+			return false;
+		}
+
+		Write(Header, Painting, Bytes);
+	}
+
+	return FFileHelper::SaveArrayToFile(Bytes, BinaryPath);
+}
+
+bool FPaintingBinaryFormat::ConvertBinaryToNdjson(const TCHAR* BinaryPath, const TCHAR* NdjsonPath)
+{
+	FPaintingBinaryReader Reader;
+	if (!Reader.Open(BinaryPath))
+		return false;
+
+	FPaintingNdjsonWriter Writer;
+	FPaintingHeader Header;
+	FPainting Painting;
+	while (Reader.ReadNext(Header, Painting))
+		Writer.WriteLine(Painting, Header.Word);
+
+	return Writer.SaveToFile(NdjsonPath);
+}
+
+FPaintingBinaryReader::FPaintingBinaryReader() = default;
+
+FPaintingBinaryReader::~FPaintingBinaryReader()
+{
+	Close();
+}
+
+bool FPaintingBinaryReader::Open(const TCHAR* FilePath)
+{
+	Close();
+
+	MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(FilePath));
+	if (!MappedFile.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FPaintingBinaryReader] Unable to map %s"), FilePath);
+		return false;
+	}
+
+	// Empty files have nothing to map
+	if (MappedFile->GetFileSize() == 0)
+		return true;
+
+	MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+	if (!MappedRegion.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FPaintingBinaryReader] Unable to map %s"), FilePath);
+		Close();
+		return false;
+	}
+
+	Bytes = TArrayView64<const uint8>(MappedRegion->GetMappedPtr(), MappedRegion->GetMappedSize());
+	return true;
+}
+
+void FPaintingBinaryReader::Close()
+{
+	// The region has to go before the file
+	Bytes = TArrayView64<const uint8>();
+	Offset = 0;
+	MappedRegion.Reset();
+	MappedFile.Reset();
+}
+
+bool FPaintingBinaryReader::ReadNext(FPaintingHeader& OutHeader, FPainting& OutPainting)
+{
+	// Records from newer versions are skipped
+	while (Offset < Bytes.Num())
+	{
+		const int64 RecordStart = Offset;
+		if (FPaintingBinaryFormat::Read(Bytes, Offset, OutHeader, OutPainting))
+			return true;
+
+		if (Offset == RecordStart)
+			return false;
+	}
+
+	return false;
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	FAutoConsoleCommand ConvertNdjsonToBinaryCommand(
+		TEXT("SpeedArtist.Paintings.NdjsonToBinary"),
+		TEXT("Converts a QuickDraw ndjson file to binary paintings. Args: <NdjsonPath> <BinaryPath>"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 2)
+				return;
+
+			const bool bOk = FPaintingBinaryFormat::ConvertNdjsonToBinary(*Args[0], *Args[1]);
+			UE_LOG(LogTemp, Display, TEXT("[FPaintingBinaryFormat] %s -> %s: %s"), *Args[0], *Args[1], bOk ? TEXT("done") : TEXT("failed"));
+		}));
+
+	// ndjson to binary and back, with an empty stroke in between two others
+	FAutoConsoleCommand RoundTripCheckCommand(
+		TEXT("SpeedArtist.Paintings.RoundTripCheck"),
+		TEXT("Converts paintings with an empty stroke to binary and back and checks nothing was lost. Args: [Directory]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			const FString Directory = Args.Num() > 0 ? Args[0] : FPaths::ProjectIntermediateDir() / TEXT("PaintingRoundTripCheck");
+			const FString NdjsonPath = Directory / TEXT("Paintings.ndjson");
+			const FString BinaryPath = Directory / TEXT("Paintings.spaint");
+			const FString RoundTripPath = Directory / TEXT("RoundTrip.ndjson");
+
+			const TArray<FString> Lines = {
+				TEXT("{\"word\":\"axe\",\"drawing\":[[[0,43,62],[59,82,104]],[[],[]],[[120,122],[0,9]]]}"),
+				TEXT("{\"word\":\"line\",\"drawing\":[[[],[]]]}"),
+				TEXT("{\"word\":\"blank\",\"drawing\":[]}")
+			};
+
+			IFileManager::Get().MakeDirectory(*Directory, true);
+			TArray<FString> RoundTripLines;
+			const bool bConverted = FFileHelper::SaveStringArrayToFile(Lines, *NdjsonPath)
+				&& FPaintingBinaryFormat::ConvertNdjsonToBinary(*NdjsonPath, *BinaryPath)
+				&& FPaintingBinaryFormat::ConvertBinaryToNdjson(*BinaryPath, *RoundTripPath)
+				&& FFileHelper::LoadFileToStringArray(RoundTripLines, *RoundTripPath);
+
+			int32 NumFailed = bConverted && RoundTripLines.Num() == Lines.Num() ? 0 : 1;
+			for (int32 i = 0; i < FMath::Min(Lines.Num(), RoundTripLines.Num()); ++i)
+			{
+				if (RoundTripLines[i] != Lines[i])
+				{
+					UE_LOG(LogTemp, Error, TEXT("[FPaintingBinaryFormat] %s came back as %s"), *Lines[i], *RoundTripLines[i]);
+					++NumFailed;
+				}
+			}
+
+			UE_LOG(LogTemp, Display, TEXT("[FPaintingBinaryFormat] Round trip check in %s: %s"), *Directory, NumFailed == 0 ? TEXT("passed") : TEXT("FAILED"));
+		}));
+
+	FAutoConsoleCommand ConvertBinaryToNdjsonCommand(
+		TEXT("SpeedArtist.Paintings.BinaryToNdjson"),
+		TEXT("Converts binary paintings to a QuickDraw ndjson file. Args: <BinaryPath> <NdjsonPath>"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 2)
+				return;
+
+			const bool bOk = FPaintingBinaryFormat::ConvertBinaryToNdjson(*Args[0], *Args[1]);
+			UE_LOG(LogTemp, Display, TEXT("[FPaintingBinaryFormat] %s -> %s: %s"), *Args[0], *Args[1], bOk ? TEXT("done") : TEXT("failed"));
+		}));
+}
+
+#endif
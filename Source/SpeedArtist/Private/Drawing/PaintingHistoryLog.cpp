@@ -0,0 +1,338 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/PaintingHistoryLog.h"
+
+#include "CanvasArea.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	constexpr int64 IndexEntrySize = sizeof(FPaintingHistoryIndexEntry);
+}
+
+FPaintingHistoryLog::FPaintingHistoryLog(const FString& InDirectory, const int64 InMaxSegmentBytes)
+	: Directory(InDirectory), MaxSegmentBytes(InMaxSegmentBytes)
+{
+	// Record indices continue from the previous sessions, a partially written entry does not count
+	const int64 IndexSize = FPlatformFileManager::Get().GetPlatformFile().FileSize(*GetIndexPath());
+	NumRecords = FMath::Max<int64>(IndexSize, 0) / IndexEntrySize;
+	NumFlushedRecords = NumRecords.load();
+
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+	Thread = FRunnableThread::Create(this, TEXT("Painting history flusher"), 0, TPri_BelowNormal);
+}
+
+FPaintingHistoryLog::~FPaintingHistoryLog()
+{
+	// Run writes whatever is still queued before returning
+	if (Thread)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+}
+
+TSharedPtr<FPaintingHistoryLog, ESPMode::ThreadSafe> FPaintingHistoryLog::GetShared(const FString& InDirectory, const int64 InMaxSegmentBytes)
+{
+	check(IsInGameThread());
+
+	// Weak, so the last canvas going away still flushes and closes the files
+	static TMap<FString, TWeakPtr<FPaintingHistoryLog, ESPMode::ThreadSafe>> SharedLogs;
+	const FString Key = FPaths::ConvertRelativePathToFull(InDirectory);
+
+	if (TSharedPtr<FPaintingHistoryLog, ESPMode::ThreadSafe> Log = SharedLogs.FindRef(Key).Pin())
+		return Log;
+
+	TSharedPtr<FPaintingHistoryLog, ESPMode::ThreadSafe> Log = MakeShared<FPaintingHistoryLog, ESPMode::ThreadSafe>(Key, InMaxSegmentBytes);
+	SharedLogs.Add(Key, Log);
+	return Log;
+}
+
+int64 FPaintingHistoryLog::Append(const FPaintingHeader& Header, const FPainting& Painting)
+{
+	FPendingRecord Record;
+	FPaintingBinaryFormat::Write(Header, Painting, Record.Bytes);
+	Record.SubmitTicks = Header.SubmitTime.GetTicks();
+	Record.Word = Header.Word;
+
+	int64 RecordIndex;
+	{
+		FScopeLock Lock(&AppendLock);
+		RecordIndex = NumRecords++;
+		PendingRecords.Enqueue(MoveTemp(Record));
+	}
+
+	WakeEvent->Trigger();
+	return RecordIndex;
+}
+
+bool FPaintingHistoryLog::ReadIndexEntry(const int64 RecordIndex, FPaintingHistoryIndexEntry& OutEntry) const
+{
+	if (RecordIndex < 0 || RecordIndex >= NumFlushedRecords)
+		return false;
+
+	const TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*GetIndexPath(), true));
+	return File.IsValid() && File->Seek(RecordIndex * IndexEntrySize) && File->Read(reinterpret_cast<uint8*>(&OutEntry), IndexEntrySize);
+}
+
+bool FPaintingHistoryLog::ReadRecord(const int64 RecordIndex, FPaintingHeader& OutHeader, FPainting& OutPainting) const
+{
+	FPaintingHistoryIndexEntry Entry;
+	if (!ReadIndexEntry(RecordIndex, Entry))
+		return false;
+
+	const TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*GetSegmentPath(Entry.Segment), true));
+	if (!File.IsValid() || !File->Seek(Entry.Offset))
+		return false;
+
+	TArray<uint8> Bytes;
+	Bytes.SetNumUninitialized(Entry.Length);
+	if (!File->Read(Bytes.GetData(), Entry.Length))
+		return false;
+
+	int64 Offset = 0;
+	return FPaintingBinaryFormat::Read(Bytes, Offset, OutHeader, OutPainting);
+}
+
+uint32 FPaintingHistoryLog::Run()
+{
+	RecoverFromDisk();
+
+	while (!bStopping)
+	{
+		WakeEvent->Wait();
+		FlushPending();
+	}
+
+	// Nothing that was appended gets lost on shutdown
+	FlushPending();
+
+	SegmentFile.Reset();
+	IndexFile.Reset();
+	return 0;
+}
+
+void FPaintingHistoryLog::Stop()
+{
+	bStopping = true;
+	WakeEvent->Trigger();
+}
+
+FString FPaintingHistoryLog::GetSegmentPath(const uint32 InSegment) const
+{
+	return FPaths::Combine(Directory, FString::Printf(TEXT("History_%05u.spaint"), InSegment));
+}
+
+FString FPaintingHistoryLog::GetIndexPath() const
+{
+	return FPaths::Combine(Directory, TEXT("History.index"));
+}
+
+void FPaintingHistoryLog::RecoverFromDisk()
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*Directory);
+
+	// Drop a partially written index entry
+	IndexFile.Reset(PlatformFile.OpenWrite(*GetIndexPath(), true, true));
+	if (!IndexFile.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FPaintingHistoryLog] Unable to open %s"), *GetIndexPath());
+		return;
+	}
+
+	const int64 NumIndexedRecords = NumFlushedRecords;
+	IndexFile->Truncate(NumIndexedRecords * IndexEntrySize);
+	IndexFile->SeekFromEnd();
+
+	// Continue the last segment, without a record that was written but never indexed
+	FPaintingHistoryIndexEntry LastEntry;
+	if (NumIndexedRecords > 0 && IndexFile->Seek((NumIndexedRecords - 1) * IndexEntrySize) && IndexFile->Read(reinterpret_cast<uint8*>(&LastEntry), IndexEntrySize))
+	{
+		IndexFile->SeekFromEnd();
+		if (OpenSegment(LastEntry.Segment))
+		{
+			SegmentSize = LastEntry.Offset + LastEntry.Length;
+			SegmentFile->Truncate(SegmentSize);
+			SegmentFile->SeekFromEnd();
+		}
+		return;
+	}
+
+	IndexFile->SeekFromEnd();
+	if (OpenSegment(0))
+	{
+		SegmentFile->Truncate(0);
+		SegmentSize = 0;
+	}
+}
+
+void FPaintingHistoryLog::FlushPending()
+{
+	if (!IndexFile.IsValid() || !SegmentFile.IsValid())
+		return;
+
+	int64 NumWritten = 0;
+	FPendingRecord Record;
+	while (PendingRecords.Dequeue(Record))
+	{
+		// Rotate by size, a record is never split across segments
+		if (SegmentSize > 0 && SegmentSize + Record.Bytes.Num() > MaxSegmentBytes)
+		{
+			SegmentFile->Flush();
+			if (!OpenSegment(Segment + 1))
+				break;
+
+			// No index entry points past the current segment, whatever a stale run or a crash left there goes
+			SegmentFile->Truncate(0);
+			SegmentFile->Seek(0);
+			SegmentSize = 0;
+		}
+
+		FPaintingHistoryIndexEntry Entry;
+		Entry.Segment = Segment;
+		Entry.Length = (uint32)Record.Bytes.Num();
+		Entry.Offset = SegmentSize;
+		Entry.SubmitTicks = Record.SubmitTicks;
+
+		const FTCHARToUTF8 Word(*Record.Word);
+		FMemory::Memcpy(Entry.Word, Word.Get(), FMath::Min<int32>(Word.Length(), sizeof(Entry.Word) - 1));
+
+		// The record goes first, so an index entry always points at complete data
+		if (SegmentFile->Write(Record.Bytes.GetData(), Record.Bytes.Num()))
+		{
+			SegmentFile->Flush();
+			SegmentSize += Record.Bytes.Num();
+		}
+		else
+		{
+			// Keep the indices aligned with an empty entry, which fails to read
+			UE_LOG(LogTemp, Error, TEXT("[FPaintingHistoryLog] Unable to write to %s"), *GetSegmentPath(Segment));
+			SegmentFile->Seek(SegmentSize);
+			Entry.Length = 0;
+		}
+
+		IndexFile->Write(reinterpret_cast<const uint8*>(&Entry), IndexEntrySize);
+		++NumWritten;
+	}
+
+	if (NumWritten == 0)
+		return;
+
+	// Readers only see a record once its bytes and its index entry are both flushed
+	IndexFile->Flush();
+	NumFlushedRecords += NumWritten;
+}
+
+bool FPaintingHistoryLog::OpenSegment(const uint32 InSegment)
+{
+	SegmentFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*GetSegmentPath(InSegment), true, true));
+	if (!SegmentFile.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FPaintingHistoryLog] Unable to open %s"), *GetSegmentPath(InSegment));
+		return false;
+	}
+
+	Segment = InSegment;
+	return true;
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	bool HasSamePoints(const FPainting& A, const FPainting& B)
+	{
+		if (A.Strokes.Num() != B.Strokes.Num())
+			return false;
+
+		for (int32 s = 0; s < A.Strokes.Num(); ++s)
+		{
+			if (A.Strokes[s].Xs != B.Strokes[s].Xs || A.Strokes[s].Ys != B.Strokes[s].Ys)
+				return false;
+		}
+
+		return true;
+	}
+
+	// Every record gets its own segment, and the segments the log rotates into already hold bytes, like a stale
+	// run or a crash between a record and its index entry leaves them. Everything has to read back afterwards.
+	void RunHistoryRecoveryCheck(const TArray<FString>& Args)
+	{
+		const FString Directory = Args.Num() > 0 ? Args[0] : FPaths::ProjectIntermediateDir() / TEXT("HistoryRecoveryCheck");
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		PlatformFile.DeleteDirectoryRecursively(*Directory);
+		PlatformFile.CreateDirectoryTree(*Directory);
+
+		TArray<uint8> Junk;
+		Junk.Init(0xAB, 1000);
+		auto WriteJunk = [&Directory, &Junk](const uint32 Segment)
+		{
+			FFileHelper::SaveArrayToFile(Junk, *FPaths::Combine(Directory, FString::Printf(TEXT("History_%05u.spaint"), Segment)));
+		};
+
+		constexpr int32 NumPaintings = 6;
+		TArray<FPainting> Paintings;
+		Paintings.SetNum(NumPaintings);
+		for (int32 i = 0; i < NumPaintings; ++i)
+		{
+			Paintings[i].Strokes.AddDefaulted();
+			for (int32 p = 0; p <= i; ++p)
+				Paintings[i].Strokes.Last().AddPoint(10 * i + p, 20 * i - p);
+		}
+
+		auto AppendRange = [&Directory, &Paintings](const int32 Start, const int32 End)
+		{
+			FPaintingHistoryLog Log(Directory, 1);
+			for (int32 i = Start; i < End; ++i)
+			{
+				FPaintingHeader Header;
+				Header.Word = FString::Printf(TEXT("check %d"), i);
+				Log.Append(Header, Paintings[i]);
+			}
+		};
+
+		// Records 0 to 2 rotate into segments 1 and 2, record 3 rotates into segment 3 after recovery
+		WriteJunk(1);
+		WriteJunk(2);
+		AppendRange(0, 3);
+		WriteJunk(3);
+		AppendRange(3, NumPaintings);
+
+		FPaintingHistoryLog Log(Directory, 1);
+		int32 NumFailed = Log.GetNumFlushedRecords() == NumPaintings ? 0 : 1;
+		for (int32 i = 0; i < NumPaintings; ++i)
+		{
+			FPaintingHistoryIndexEntry Entry;
+			FPaintingHeader Header;
+			FPainting Painting;
+			const bool bOk = Log.ReadIndexEntry(i, Entry) && Log.ReadRecord(i, Header, Painting) && Header.Word == FString::Printf(TEXT("check %d"), i)
+				&& HasSamePoints(Painting, Paintings[i])
+				&& Entry.Offset == 0 && PlatformFile.FileSize(*FPaths::Combine(Directory, FString::Printf(TEXT("History_%05u.spaint"), Entry.Segment))) == Entry.Length;
+
+			if (!bOk)
+			{
+				UE_LOG(LogTemp, Error, TEXT("[FPaintingHistoryLog] Record %d does not read back"), i);
+				++NumFailed;
+			}
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("[FPaintingHistoryLog] Recovery check in %s: %s"), *Directory, NumFailed == 0 ? TEXT("passed") : TEXT("FAILED"));
+	}
+
+	FAutoConsoleCommand HistoryRecoveryCheckCommand(
+		TEXT("SpeedArtist.Paintings.HistoryRecoveryCheck"),
+		TEXT("Writes a history log that rotates into existing segment files, reopens it and reads every record back. Deletes the directory first. Args: [Directory]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunHistoryRecoveryCheck));
+}
+
+#endif
@@ -0,0 +1,208 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/PaintingNdjsonWriter.h"
+
+#include "CanvasArea.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+
+namespace
+{
+	// "-32768," is the longest coordinate
+	constexpr int32 MaxBytesPerCoordinate = 7;
+
+	// "[[" "],[" "]]," around the two axes of a stroke, plus the brackets of the drawing
+	constexpr int32 MaxBytesPerStroke = 8;
+
+	int32 GetMaxDrawingBytes(const FPainting& Painting)
+	{
+		int32 NumBytes = 2;
+		for (const FStroke& Stroke : Painting.Strokes)
+			NumBytes += MaxBytesPerStroke + 2 * MaxBytesPerCoordinate * Stroke.Num();
+
+		return NumBytes;
+	}
+}
+
+void FPaintingNdjsonWriter::Reset()
+{
+	Buffer.Reset();
+}
+
+void FPaintingNdjsonWriter::WriteLine(const FPainting& Painting, const FString& Word)
+{
+	static constexpr ANSICHAR Prefix[] = "{\"word\":\"";
+	static constexpr ANSICHAR Infix[] = "\",\"drawing\":";
+	static constexpr ANSICHAR Terminator[] = LINE_TERMINATOR_ANSI;
+
+	// The word is written as is, the same way the FString::Format version did
+	const int32 WordBytes = FPlatformString::ConvertedLength<UTF8CHAR>(*Word, Word.Len());
+	uint8* Out = Begin(sizeof(Prefix) + WordBytes + sizeof(Infix));
+	Out = WriteLiteral(Out, Prefix, sizeof(Prefix) - 1);
+	FPlatformString::Convert(reinterpret_cast<UTF8CHAR*>(Out), WordBytes, *Word, Word.Len());
+	Out += WordBytes;
+	Out = WriteLiteral(Out, Infix, sizeof(Infix) - 1);
+	Commit(Out);
+
+	WriteDrawing(Painting);
+
+	Out = Begin(sizeof(Terminator));
+	*Out++ = '}';
+	Out = WriteLiteral(Out, Terminator, sizeof(Terminator) - 1);
+	Commit(Out);
+}
+
+void FPaintingNdjsonWriter::WriteDrawing(const FPainting& Painting)
+{
+	uint8* Out = Begin(GetMaxDrawingBytes(Painting));
+
+	*Out++ = '[';
+	for (int32 i = 0; i < Painting.Strokes.Num(); ++i)
+	{
+		if (i > 0)
+			*Out++ = ',';
+
+		Out = WriteStroke(Out, Painting.Strokes[i]);
+	}
+	*Out++ = ']';
+
+	Commit(Out);
+}
+
+bool FPaintingNdjsonWriter::SaveToFile(const TCHAR* FilePath) const
+{
+	return FFileHelper::SaveArrayToFile(Buffer, FilePath);
+}
+
+uint8* FPaintingNdjsonWriter::Begin(const int32 NumBytes)
+{
+	const int32 Offset = Buffer.Num();
+	Buffer.AddUninitialized(NumBytes);
+	return Buffer.GetData() + Offset;
+}
+
+void FPaintingNdjsonWriter::Commit(const uint8* End)
+{
+	Buffer.SetNum(End - Buffer.GetData(), EAllowShrinking::No);
+}
+
+uint8* FPaintingNdjsonWriter::WriteStroke(uint8* Out, const FStroke& Stroke)
+{
+	*Out++ = '[';
+	Out = WriteAxis(Out, Stroke, Stroke.GetXs());
+	*Out++ = ',';
+	Out = WriteAxis(Out, Stroke, Stroke.GetYs());
+	*Out++ = ']';
+	return Out;
+}
+
+uint8* FPaintingNdjsonWriter::WriteAxis(uint8* Out, const FStroke& Stroke, TConstArrayView<int16> Values)
+{
+	*Out++ = '[';
+	for (int32 i = 0; i < Values.Num(); ++i)
+	{
+		// Skip over simplified points, the separator rule matches FStroke::Serialize
+		if (!Stroke.IsKept(i))
+			continue;
+
+		if (i > 0)
+			*Out++ = ',';
+
+		Out = WriteInt(Out, Values[i]);
+	}
+	*Out++ = ']';
+	return Out;
+}
+
+uint8* FPaintingNdjsonWriter::WriteInt(uint8* Out, const int32 Value)
+{
+	uint32 Magnitude = Value < 0 ? 0u - (uint32)Value : (uint32)Value;
+	if (Value < 0)
+		*Out++ = '-';
+
+	// Digits come out backwards
+	uint8 Digits[10];
+	int32 NumDigits = 0;
+	do
+	{
+		Digits[NumDigits++] = (uint8)('0' + Magnitude % 10);
+		Magnitude /= 10;
+	}
+	while (Magnitude > 0);
+
+	while (NumDigits > 0)
+		*Out++ = Digits[--NumDigits];
+
+	return Out;
+}
+
+uint8* FPaintingNdjsonWriter::WriteLiteral(uint8* Out, const ANSICHAR* Literal, const int32 Length)
+{
+	FMemory::Memcpy(Out, Literal, Length);
+	return Out + Length;
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	void RunNdjsonWriterBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumStrokes = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 200;
+		const int32 PointsPerStroke = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 60;
+		const int32 Iterations = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 200;
+
+		FRandomStream Random(1234);
+		FPainting Painting;
+		for (int32 i = 0; i < NumStrokes; ++i)
+		{
+			FStroke Stroke;
+			for (int32 j = 0; j < PointsPerStroke; ++j)
+				Stroke.AddPoint(Random.RandRange(0, 1023), Random.RandRange(0, 1023));
+
+			Stroke.Simplify(2.0f);
+			Painting.AddStroke(Stroke);
+		}
+
+		const FString Word = TEXT("airplane");
+
+		// The previous path, as FFileHelper::SaveStringArrayToFile wrote it
+		const double StringStart = FPlatformTime::Seconds();
+		FString Line;
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			Line = FString::Format(TEXT("{\"word\":\"{0}\",\"drawing\":{1}}"), { *Word, *Painting.Serialize() }) + LINE_TERMINATOR;
+		const double StringSeconds = FPlatformTime::Seconds() - StringStart;
+
+		// Count the buffer reallocations once the writer is warmed up
+		FPaintingNdjsonWriter Writer;
+		Writer.WriteLine(Painting, Word);
+
+		int32 Reallocations = 0;
+		const double WriterStart = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			const uint8* Data = Writer.GetBytes().GetData();
+			Writer.Reset();
+			Writer.WriteLine(Painting, Word);
+			Reallocations += Writer.GetBytes().GetData() != Data ? 1 : 0;
+		}
+		const double WriterSeconds = FPlatformTime::Seconds() - WriterStart;
+
+		const FTCHARToUTF8 Expected(*Line);
+		const bool bIdentical = Expected.Length() == Writer.GetBytes().Num() && FMemory::Memcmp(Expected.Get(), Writer.GetBytes().GetData(), Expected.Length()) == 0;
+
+		UE_LOG(LogTemp, Display, TEXT("[FPaintingNdjsonWriter] %d strokes of %d points, %d bytes per line, %d iterations"), NumStrokes, PointsPerStroke, Writer.GetBytes().Num(), Iterations);
+		UE_LOG(LogTemp, Display, TEXT("[FPaintingNdjsonWriter] FString path: %.3f ms"), StringSeconds * 1000.0);
+		UE_LOG(LogTemp, Display, TEXT("[FPaintingNdjsonWriter] Writer:       %.3f ms, %d buffer reallocations after warm-up"), WriterSeconds * 1000.0, Reallocations);
+		UE_LOG(LogTemp, Display, TEXT("[FPaintingNdjsonWriter] Output identical: %s"), bIdentical ? TEXT("true") : TEXT("false"));
+	}
+
+	FAutoConsoleCommand BenchmarkNdjsonWriterCommand(
+		TEXT("SpeedArtist.Benchmark.NdjsonWriter"),
+		TEXT("Times the ndjson writer against the FString serialization and checks the bytes match. Args: [NumStrokes] [PointsPerStroke] [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunNdjsonWriterBenchmark));
+}
+
+#endif
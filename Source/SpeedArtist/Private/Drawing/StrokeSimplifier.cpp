@@ -0,0 +1,279 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/StrokeSimplifier.h"
+
+#include "CanvasArea.h"
+#include "Dom/JsonObject.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	struct FSegmentRange
+	{
+		int32 Left;
+		int32 Right;
+	};
+
+	// Distance exactly as the previous implementation computed it
+	float GetReferenceDistance(TConstArrayView<int16> Xs, TConstArrayView<int16> Ys, const int32 Index, const int32 Left, const int32 Right)
+	{
+		return FMath::PointDistToSegment(FVector(Xs[Index], Ys[Index], 0), FVector(Xs[Left], Ys[Left], 0), FVector(Xs[Right], Ys[Right], 0));
+	}
+
+	// Squared distance from point P to the segment [A, A + D]
+	FORCEINLINE double GetDistanceSquared(const int64 Px, const int64 Py, const int64 Dx, const int64 Dy, const int64 LengthSquared)
+	{
+		const int64 Projection = Px * Dx + Py * Dy;
+		if (Projection <= 0)
+			return (double)(Px * Px + Py * Py);
+
+		if (Projection >= LengthSquared)
+			return (double)((Px - Dx) * (Px - Dx) + (Py - Dy) * (Py - Dy));
+
+		const int64 Cross = Px * Dy - Py * Dx;
+		return (double)(Cross * Cross) / (double)LengthSquared;
+	}
+
+	// Relative squared distance below which two points may have the same float distance
+	constexpr double TieTolerance = 1e-5;
+
+	void SimplifyReferenceRec(TConstArrayView<int16> Xs, TConstArrayView<int16> Ys, const float Eps, const int32 Left, const int32 Right, TBitArray<>& KeepFlags)
+	{
+		KeepFlags[Left] = true;
+		KeepFlags[Right] = true;
+
+		if (Left + 1 >= Right)
+			return;
+
+		float MaxDist = -1;
+		int32 MaxPos = -1;
+		for (int32 i = Left + 1; i < Right; ++i)
+		{
+			const float Dist = GetReferenceDistance(Xs, Ys, i, Left, Right);
+			if (Dist > MaxDist)
+			{
+				MaxDist = Dist;
+				MaxPos = i;
+			}
+		}
+
+		if (MaxDist < Eps)
+			return;
+
+		SimplifyReferenceRec(Xs, Ys, Eps, Left, MaxPos, KeepFlags);
+		SimplifyReferenceRec(Xs, Ys, Eps, MaxPos, Right, KeepFlags);
+	}
+}
+
+void FStrokeSimplifier::Simplify(TConstArrayView<int16> Xs, TConstArrayView<int16> Ys, const float Eps, TBitArray<>& OutKeepFlags)
+{
+	const int32 NumPoints = Xs.Num();
+	OutKeepFlags.Init(false, NumPoints);
+	if (NumPoints == 0)
+		return;
+
+	// Reused by every stroke simplified on this thread
+	thread_local TArray<FSegmentRange> Stack;
+	Stack.Reset();
+	Stack.Add(FSegmentRange{ 0, NumPoints - 1 });
+
+	while (Stack.Num() > 0)
+	{
+		const FSegmentRange Range = Stack.Pop(EAllowShrinking::No);
+		const int32 Left = Range.Left;
+		const int32 Right = Range.Right;
+
+		// Set the endpoints as fixed
+		OutKeepFlags[Left] = true;
+		OutKeepFlags[Right] = true;
+
+		// Stop if we cannot divide anymore
+		if (Left + 1 >= Right)
+			continue;
+
+		// Find the farthest point
+		const int64 Ax = Xs[Left];
+		const int64 Ay = Ys[Left];
+		const int64 Dx = Xs[Right] - Ax;
+		const int64 Dy = Ys[Right] - Ay;
+		const int64 LengthSquared = Dx * Dx + Dy * Dy;
+
+		double MaxDistSquared = -1.0;
+		int32 MaxPos = Left + 1;
+		for (int32 i = Left + 1; i < Right; ++i)
+		{
+			const double DistSquared = GetDistanceSquared(Xs[i] - Ax, Ys[i] - Ay, Dx, Dy, LengthSquared);
+			if (DistSquared > MaxDistSquared)
+			{
+				MaxDistSquared = DistSquared;
+				MaxPos = i;
+			}
+		}
+
+		// Float distances may tie or swap for points this close to the maximum, settle them the way the reference does
+		float MaxDist = GetReferenceDistance(Xs, Ys, MaxPos, Left, Right);
+		const double TieThreshold = MaxDistSquared * (1.0 - TieTolerance);
+		for (int32 i = Left + 1; i < Right; ++i)
+		{
+			if (i == MaxPos || GetDistanceSquared(Xs[i] - Ax, Ys[i] - Ay, Dx, Dy, LengthSquared) < TieThreshold)
+				continue;
+
+			const float Dist = GetReferenceDistance(Xs, Ys, i, Left, Right);
+			if (Dist > MaxDist || (Dist == MaxDist && i < MaxPos))
+			{
+				MaxDist = Dist;
+				MaxPos = i;
+			}
+		}
+
+		// Stop if we've reached the desired error
+		if (MaxDist < Eps)
+			continue;
+
+		Stack.Add(FSegmentRange{ MaxPos, Right });
+		Stack.Add(FSegmentRange{ Left, MaxPos });
+	}
+}
+
+void FStrokeSimplifier::SimplifyReference(TConstArrayView<int16> Xs, TConstArrayView<int16> Ys, const float Eps, TBitArray<>& OutKeepFlags)
+{
+	OutKeepFlags.Init(false, Xs.Num());
+	if (Xs.Num() > 0)
+		SimplifyReferenceRec(Xs, Ys, Eps, 0, Xs.Num() - 1, OutKeepFlags);
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	struct FBenchmarkStroke
+	{
+		TArray<int16> Xs;
+		TArray<int16> Ys;
+	};
+
+	// Reads the "drawing" field of every QuickDraw ndjson line in a directory
+	void LoadStrokes(const FString& Directory, TArray<FBenchmarkStroke>& OutStrokes)
+	{
+		TArray<FString> FileNames;
+		IFileManager::Get().FindFiles(FileNames, *FPaths::Combine(Directory, TEXT("*.ndjson")), true, false);
+
+		for (const FString& FileName : FileNames)
+		{
+			TArray<FString> Lines;
+			FFileHelper::LoadFileToStringArray(Lines, *FPaths::Combine(Directory, FileName));
+
+			for (const FString& Line : Lines)
+			{
+				TSharedPtr<FJsonObject> Object;
+				if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Line), Object) || !Object.IsValid())
+					continue;
+
+				const TArray<TSharedPtr<FJsonValue>>* Drawing = nullptr;
+				if (!Object->TryGetArrayField(TEXT("drawing"), Drawing))
+					continue;
+
+				for (const TSharedPtr<FJsonValue>& StrokeValue : *Drawing)
+				{
+					const TArray<TSharedPtr<FJsonValue>>& Axes = StrokeValue->AsArray();
+					if (Axes.Num() < 2)
+						continue;
+
+					FBenchmarkStroke& Stroke = OutStrokes.AddDefaulted_GetRef();
+					for (const TSharedPtr<FJsonValue>& Value : Axes[0]->AsArray())
+						Stroke.Xs.Add((int16)Value->AsNumber());
+					for (const TSharedPtr<FJsonValue>& Value : Axes[1]->AsArray())
+						Stroke.Ys.Add((int16)Value->AsNumber());
+
+					Stroke.Xs.SetNum(FMath::Min(Stroke.Xs.Num(), Stroke.Ys.Num()));
+					Stroke.Ys.SetNum(Stroke.Xs.Num());
+				}
+			}
+		}
+	}
+
+	void RunStrokeSimplifyBenchmark(const TArray<FString>& Args)
+	{
+		const FString Directory = Args.Num() > 0 ? Args[0] : FPaths::ProjectContentDir() / TEXT("PaintingHistory");
+		const int32 Iterations = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1000;
+		const float Eps = Args.Num() > 2 ? FCString::Atof(*Args[2]) : 2.0f;
+
+		TArray<FBenchmarkStroke> Strokes;
+		LoadStrokes(Directory, Strokes);
+		if (Strokes.Num() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[FStrokeSimplifier] No strokes found in %s"), *Directory);
+			return;
+		}
+
+		int64 NumPoints = 0;
+		int32 Mismatches = 0;
+		TBitArray<> ReferenceFlags, Flags;
+		for (const FBenchmarkStroke& Stroke : Strokes)
+		{
+			NumPoints += Stroke.Xs.Num();
+			FStrokeSimplifier::SimplifyReference(Stroke.Xs, Stroke.Ys, Eps, ReferenceFlags);
+			FStrokeSimplifier::Simplify(Stroke.Xs, Stroke.Ys, Eps, Flags);
+			Mismatches += ReferenceFlags != Flags ? 1 : 0;
+		}
+
+		const double ReferenceStart = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			for (const FBenchmarkStroke& Stroke : Strokes)
+				FStrokeSimplifier::SimplifyReference(Stroke.Xs, Stroke.Ys, Eps, ReferenceFlags);
+		const double ReferenceSeconds = FPlatformTime::Seconds() - ReferenceStart;
+
+		const double IterativeStart = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			for (const FBenchmarkStroke& Stroke : Strokes)
+				FStrokeSimplifier::Simplify(Stroke.Xs, Stroke.Ys, Eps, Flags);
+		const double IterativeSeconds = FPlatformTime::Seconds() - IterativeStart;
+
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeSimplifier] %d strokes, %lld points, eps %.2f, %d iterations"), Strokes.Num(), NumPoints, Eps, Iterations);
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeSimplifier] Recursive: %.3f ms"), ReferenceSeconds * 1000.0);
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeSimplifier] Iterative: %.3f ms"), IterativeSeconds * 1000.0);
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeSimplifier] Strokes with different output: %d"), Mismatches);
+
+		// Point by point like ACanvasArea draws them, a tail at a time for the live predictions, against simplifying each finished stroke whole
+		int64 WholeKept = 0, TailKept = 0;
+		int64 NumTailCalls = 0;
+		double TailSeconds = 0.0, WorstTailSeconds = 0.0;
+		for (const FBenchmarkStroke& Stroke : Strokes)
+		{
+			FStroke Drawn;
+			for (int32 i = 0; i < Stroke.Xs.Num(); ++i)
+			{
+				Drawn.AddPoint(Stroke.Xs[i], Stroke.Ys[i]);
+				if (Drawn.Num() % FStroke::SimplifyTailPoints != 0 && i + 1 < Stroke.Xs.Num())
+					continue;
+
+				const double TailStart = FPlatformTime::Seconds();
+				Drawn.SimplifyTail(Eps);
+				const double Seconds = FPlatformTime::Seconds() - TailStart;
+				TailSeconds += Seconds;
+				WorstTailSeconds = FMath::Max(WorstTailSeconds, Seconds);
+				++NumTailCalls;
+			}
+
+			TailKept += Drawn.KeepFlags.CountSetBits();
+			Drawn.Simplify(Eps);
+			WholeKept += Drawn.KeepFlags.CountSetBits();
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeSimplifier] Drawn a tail at a time: %lld provisional kept points against %lld whole, a tail takes %.3f ms, %.3f ms at worst"),
+			TailKept, WholeKept, TailSeconds * 1000.0 / FMath::Max(NumTailCalls, (int64)1), WorstTailSeconds * 1000.0);
+	}
+
+	FAutoConsoleCommand BenchmarkStrokeSimplifyCommand(
+		TEXT("SpeedArtist.Benchmark.StrokeSimplify"),
+		TEXT("Times the iterative stroke simplifier against the recursive one and checks they agree, then replays the strokes as they are drawn. Args: [Directory] [Iterations] [Eps]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunStrokeSimplifyBenchmark));
+}
+
+#endif
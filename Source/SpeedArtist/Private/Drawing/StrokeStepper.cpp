@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Drawing/StrokeStepper.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+namespace
+{
+	// Floor division and matching non-negative remainder, for a positive divisor
+	void FloorDivide(const int32 Numerator, const int32 Divisor, int32& OutQuotient, int32& OutRemainder)
+	{
+		OutQuotient = Numerator / Divisor;
+		OutRemainder = Numerator % Divisor;
+		if (OutRemainder < 0)
+		{
+			--OutQuotient;
+			OutRemainder += Divisor;
+		}
+	}
+}
+
+FStrokeStepper::FStrokeStepper(const FIntPoint Start, const FIntPoint End, const int32 Radius)
+	: End(End), Current(Start)
+{
+	const FIntPoint Delta = End - Start;
+	StepCount = ComputeStepCount(Delta, Radius);
+
+	if (StepCount > 0)
+	{
+		FloorDivide(Delta.X, StepCount, QuotientX, RemainderX);
+		FloorDivide(Delta.Y, StepCount, QuotientY, RemainderY);
+	}
+}
+
+int32 FStrokeStepper::ComputeStepCount(const FIntPoint Delta, const int32 Radius)
+{
+	if (Radius <= 0)
+		return 0;
+
+	// Largest k with k * Radius / 2 <= sqrt(D2), i.e. k^2 * Radius^2 <= 4 * D2
+	const int64 DistanceSquared4 = 4 * ((int64)Delta.X * Delta.X + (int64)Delta.Y * Delta.Y);
+	const int64 RadiusSquared = (int64)Radius * Radius;
+
+	// Start from the float estimate and fix it up exactly
+	int64 Steps = (int64)(2.0 * FMath::Sqrt((double)((int64)Delta.X * Delta.X + (int64)Delta.Y * Delta.Y)) / Radius);
+	while (Steps > 0 && Steps * Steps * RadiusSquared > DistanceSquared4)
+		--Steps;
+	while ((Steps + 1) * (Steps + 1) * RadiusSquared <= DistanceSquared4)
+		++Steps;
+
+	return (int32)Steps;
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	void RunStrokeSteppingBenchmark(const TArray<FString>& Args)
+	{
+		const int32 SegmentCount = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 200000;
+		const int32 Radius = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 10;
+
+		FRandomStream Random(1234);
+		TArray<FIntPoint> Points;
+		Points.SetNumUninitialized(SegmentCount + 1);
+		for (FIntPoint& Point : Points)
+			Point = FIntPoint(Random.RandRange(0, 1023), Random.RandRange(0, 1023));
+
+		// The float loop previously used by ACanvasArea::Draw
+		int64 FloatChecksum = 0;
+		int64 FloatStamps = 0;
+		const double FloatStart = FPlatformTime::Seconds();
+		for (int32 i = 0; i < SegmentCount; ++i)
+		{
+			const UE::Math::TVector2<float> PrevCoords(Points[i].X, Points[i].Y);
+			const UE::Math::TVector2<float> Coords(Points[i + 1].X, Points[i + 1].Y);
+			const float DistanceBetweenPoints = UE::Math::TVector2<float>::Distance(PrevCoords, Coords);
+			const float StepCount = floorf(DistanceBetweenPoints / (Radius / 2.0f));
+
+			if (StepCount > 0)
+			{
+				const float Step = DistanceBetweenPoints / StepCount;
+				for (float Alpha = 0.0f; Alpha < DistanceBetweenPoints; Alpha += Step)
+				{
+					const UE::Math::TVector2<float> NewCoords = PrevCoords + (Coords - PrevCoords) * (Alpha / DistanceBetweenPoints);
+					FloatChecksum += (int32)NewCoords.X + (int32)NewCoords.Y;
+					++FloatStamps;
+				}
+			}
+
+			FloatChecksum += Points[i + 1].X + Points[i + 1].Y;
+			++FloatStamps;
+		}
+		const double FloatSeconds = FPlatformTime::Seconds() - FloatStart;
+
+		int64 IntegerChecksum = 0;
+		int64 IntegerStamps = 0;
+		const double IntegerStart = FPlatformTime::Seconds();
+		for (int32 i = 0; i < SegmentCount; ++i)
+		{
+			FStrokeStepper Stepper(Points[i], Points[i + 1], Radius);
+			FIntPoint Center;
+			while (Stepper.Next(Center))
+			{
+				IntegerChecksum += Center.X + Center.Y;
+				++IntegerStamps;
+			}
+		}
+		const double IntegerSeconds = FPlatformTime::Seconds() - IntegerStart;
+
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeStepper] %d segments, radius %d"), SegmentCount, Radius);
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeStepper] Float loop:   %.3f ms, %lld stamps (checksum %lld)"), FloatSeconds * 1000.0, FloatStamps, FloatChecksum);
+		UE_LOG(LogTemp, Display, TEXT("[FStrokeStepper] Integer DDA:  %.3f ms, %lld stamps (checksum %lld)"), IntegerSeconds * 1000.0, IntegerStamps, IntegerChecksum);
+	}
+
+	FAutoConsoleCommand BenchmarkStrokeSteppingCommand(
+		TEXT("SpeedArtist.Benchmark.StrokeStepping"),
+		TEXT("Times the integer stroke stepper against the previous float stamping loop. Args: [SegmentCount] [Radius]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunStrokeSteppingBenchmark));
+}
+
+#endif
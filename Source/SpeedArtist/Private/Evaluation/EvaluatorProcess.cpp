@@ -0,0 +1,338 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Evaluation/EvaluatorProcess.h"
+
+#include "Async/Async.h"
+#include "Dom/JsonObject.h"
+#include "HAL/RunnableThread.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	// Output of the worker that is not part of a frame, e.g. Python warnings, which share the pipe on Windows
+	void LogWorkerOutput(const uint8* Data, const int32 NumBytes)
+	{
+		if (NumBytes <= 0)
+			return;
+
+		const FString Output = FString(NumBytes, reinterpret_cast<const UTF8CHAR*>(Data)).TrimStartAndEnd();
+		if (!Output.IsEmpty())
+			UE_LOG(LogTemp, Display, TEXT("[FEvaluatorProcess] Worker: %s"), *Output);
+	}
+}
+
+FEvaluatorProcess::FEvaluatorProcess(const FEvaluatorSettings& InSettings)
+	: Settings(InSettings)
+{
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+	Thread = FRunnableThread::Create(this, TEXT("Evaluator process"), 0, TPri_BelowNormal);
+}
+
+FEvaluatorProcess::~FEvaluatorProcess()
+{
+	if (Thread)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+}
+
+void FEvaluatorProcess::Evaluate(TArray<uint8>&& NdjsonLine, FOnEvaluationComplete&& OnComplete)
+{
+	Requests.Enqueue(FRequest{ MoveTemp(NdjsonLine), MoveTemp(OnComplete) });
+	WakeEvent->Trigger();
+}
+
+uint32 FEvaluatorProcess::Run()
+{
+	bool bStartedBefore = false;
+	while (!bStopping)
+	{
+		if (!IsProcessRunning())
+		{
+			// Do not spin on a worker that keeps exiting
+			if (bStartedBefore)
+				WakeEvent->Wait(FTimespan::FromSeconds(Settings.RestartDelaySeconds));
+
+			if (bStopping)
+				break;
+
+			bStartedBefore = true;
+			if (!StartProcess())
+			{
+				// Rather than leaving the game waiting for an answer
+				FRequest Request;
+				while (Requests.Dequeue(Request))
+					Complete(Request, FEvaluationResult{ false, {}, {}, TEXT("The evaluator could not be started") });
+				continue;
+			}
+		}
+
+		FRequest Request;
+		if (!Requests.Dequeue(Request))
+		{
+			WakeEvent->Wait(FTimespan::FromMilliseconds(100));
+			DrainOutput();
+			continue;
+		}
+
+		FEvaluationResult Result = RoundTrip(Request.Payload);
+
+		// A worker that crashed mid-request gets one more try after a restart
+		if (!Result.bSuccess && !IsProcessRunning() && !bStopping)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[FEvaluatorProcess] The evaluator exited during a request, restarting it"));
+			FPlatformProcess::Sleep(Settings.RestartDelaySeconds);
+			if (StartProcess())
+				Result = RoundTrip(Request.Payload);
+		}
+
+		Complete(Request, MoveTemp(Result));
+	}
+
+	StopProcess();
+
+	FRequest Request;
+	while (Requests.Dequeue(Request))
+		Complete(Request, FEvaluationResult{ false, {}, {}, TEXT("The evaluator was shut down") });
+
+	return 0;
+}
+
+void FEvaluatorProcess::Stop()
+{
+	bStopping = true;
+	WakeEvent->Trigger();
+}
+
+bool FEvaluatorProcess::IsProcessRunning()
+{
+	if (!ProcessHandle.IsValid())
+		return false;
+
+	if (FPlatformProcess::IsProcRunning(ProcessHandle))
+		return true;
+
+	int32 ReturnCode = 0;
+	FPlatformProcess::GetProcReturnCode(ProcessHandle, &ReturnCode);
+	UE_LOG(LogTemp, Warning, TEXT("[FEvaluatorProcess] The evaluator exited with code %d"), ReturnCode);
+
+	StopProcess();
+	return false;
+}
+
+bool FEvaluatorProcess::StartProcess()
+{
+	StopProcess();
+
+	// The child writes to StdOutWrite and reads from StdInRead, our end of its stdin must not be inherited
+	if (!FPlatformProcess::CreatePipe(StdOutRead, StdOutWrite))
+		return false;
+
+	if (!FPlatformProcess::CreatePipe(StdInRead, StdInWrite, true))
+	{
+		FPlatformProcess::ClosePipe(StdOutRead, StdOutWrite);
+		StdOutRead = StdOutWrite = nullptr;
+		return false;
+	}
+
+	uint32 ProcessId = 0;
+	ProcessHandle = FPlatformProcess::CreateProc(*Settings.Executable, *Settings.Arguments, false, true, true, &ProcessId, 0,
+		Settings.WorkingDirectory.IsEmpty() ? nullptr : *Settings.WorkingDirectory, StdOutWrite, StdInRead);
+
+	if (!ProcessHandle.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FEvaluatorProcess] Unable to start %s %s"), *Settings.Executable, *Settings.Arguments);
+		StopProcess();
+		return false;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("[FEvaluatorProcess] Started the evaluator (pid %u)"), ProcessId);
+	return true;
+}
+
+void FEvaluatorProcess::StopProcess()
+{
+	// Closing its stdin lets the worker exit on its own
+	if (StdInRead || StdInWrite)
+		FPlatformProcess::ClosePipe(StdInRead, StdInWrite);
+	StdInRead = StdInWrite = nullptr;
+
+	if (ProcessHandle.IsValid())
+	{
+		const double Deadline = FPlatformTime::Seconds() + 2.0;
+		while (FPlatformProcess::IsProcRunning(ProcessHandle) && FPlatformTime::Seconds() < Deadline)
+			FPlatformProcess::Sleep(0.01f);
+
+		if (FPlatformProcess::IsProcRunning(ProcessHandle))
+			FPlatformProcess::TerminateProc(ProcessHandle, true);
+
+		FPlatformProcess::CloseProc(ProcessHandle);
+		ProcessHandle.Reset();
+	}
+
+	if (StdOutRead || StdOutWrite)
+		FPlatformProcess::ClosePipe(StdOutRead, StdOutWrite);
+	StdOutRead = StdOutWrite = nullptr;
+
+	ReceiveBuffer.Reset();
+}
+
+bool FEvaluatorProcess::SendFrame(const TArray<uint8>& Payload)
+{
+	TArray<uint8> Frame;
+	Frame.Reserve(FrameHeaderSize + Payload.Num());
+	const uint32 Header[2] = { FrameMagic, (uint32)Payload.Num() };
+	Frame.Append(reinterpret_cast<const uint8*>(Header), FrameHeaderSize);
+	Frame.Append(Payload);
+
+	int32 Offset = 0;
+	while (Offset < Frame.Num())
+	{
+		int32 Written = 0;
+		if (!FPlatformProcess::WritePipe(StdInWrite, Frame.GetData() + Offset, Frame.Num() - Offset, &Written) || Written <= 0)
+			return false;
+
+		Offset += Written;
+	}
+
+	return true;
+}
+
+bool FEvaluatorProcess::ReceiveFrame(TArray<uint8>& OutPayload, const double TimeoutSeconds)
+{
+	const double Deadline = FPlatformTime::Seconds() + TimeoutSeconds;
+	TArray<uint8> Chunk;
+	while (!bStopping)
+	{
+		if (ExtractFrame(OutPayload))
+			return true;
+
+		if (FPlatformProcess::ReadPipeToArray(StdOutRead, Chunk))
+		{
+			ReceiveBuffer.Append(Chunk);
+			continue;
+		}
+
+		// Whatever the worker wrote before exiting has been read by now
+		if (!IsProcessRunning() || FPlatformTime::Seconds() > Deadline)
+			return false;
+
+		FPlatformProcess::Sleep(0.001f);
+	}
+
+	return false;
+}
+
+bool FEvaluatorProcess::ExtractFrame(TArray<uint8>& OutPayload)
+{
+	// Skip to the next frame header
+	int32 Start = 0;
+	while (Start + 4 <= ReceiveBuffer.Num() && FMemory::Memcmp(ReceiveBuffer.GetData() + Start, &FrameMagic, 4) != 0)
+		++Start;
+
+	// Keep up to 3 bytes that may be the start of a header
+	if (Start + 4 > ReceiveBuffer.Num())
+		Start = FMath::Max(ReceiveBuffer.Num() - 3, 0);
+
+	LogWorkerOutput(ReceiveBuffer.GetData(), Start);
+	ReceiveBuffer.RemoveAt(0, Start, EAllowShrinking::No);
+
+	if (ReceiveBuffer.Num() < FrameHeaderSize || FMemory::Memcmp(ReceiveBuffer.GetData(), &FrameMagic, 4) != 0)
+		return false;
+
+	uint32 Length = 0;
+	FMemory::Memcpy(&Length, ReceiveBuffer.GetData() + 4, 4);
+	if (ReceiveBuffer.Num() < FrameHeaderSize + (int64)Length)
+		return false;
+
+	OutPayload.Reset();
+	OutPayload.Append(ReceiveBuffer.GetData() + FrameHeaderSize, Length);
+	ReceiveBuffer.RemoveAt(0, FrameHeaderSize + Length, EAllowShrinking::No);
+	return true;
+}
+
+void FEvaluatorProcess::DrainOutput()
+{
+	if (!StdOutRead)
+		return;
+
+	TArray<uint8> Chunk;
+	while (FPlatformProcess::ReadPipeToArray(StdOutRead, Chunk))
+		ReceiveBuffer.Append(Chunk);
+
+	// Answers to requests that already timed out
+	TArray<uint8> StalePayload;
+	while (ExtractFrame(StalePayload))
+		UE_LOG(LogTemp, Warning, TEXT("[FEvaluatorProcess] Dropping a late response"));
+}
+
+FEvaluationResult FEvaluatorProcess::RoundTrip(const TArray<uint8>& Payload)
+{
+	if (!SendFrame(Payload))
+		return FEvaluationResult{ false, {}, {}, TEXT("Unable to send the request to the evaluator") };
+
+	TArray<uint8> Response;
+	if (!ReceiveFrame(Response, Settings.RequestTimeoutSeconds))
+	{
+		// A worker that stopped answering is replaced on the next loop
+		if (IsProcessRunning())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[FEvaluatorProcess] The evaluator did not answer in %.1f s, restarting it"), Settings.RequestTimeoutSeconds);
+			StopProcess();
+		}
+
+		return FEvaluationResult{ false, {}, {}, TEXT("The evaluator did not answer") };
+	}
+
+	return ParseResponse(Response);
+}
+
+FEvaluationResult FEvaluatorProcess::ParseResponse(const TArray<uint8>& Payload)
+{
+	FEvaluationResult Result;
+
+	TSharedPtr<FJsonObject> Object;
+	const FString Json(Payload.Num(), reinterpret_cast<const UTF8CHAR*>(Payload.GetData()));
+	if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Json), Object) || !Object.IsValid())
+	{
+		Result.Error = TEXT("Invalid response from the evaluator");
+		return Result;
+	}
+
+	if (Object->TryGetStringField(TEXT("error"), Result.Error))
+		return Result;
+
+	if (!Object->TryGetStringField(TEXT("class"), Result.ClassName))
+	{
+		Result.Error = TEXT("The evaluator response has no class");
+		return Result;
+	}
+
+	const TArray<TSharedPtr<FJsonValue>>* Scores = nullptr;
+	if (Object->TryGetArrayField(TEXT("scores"), Scores))
+	{
+		for (const TSharedPtr<FJsonValue>& Score : *Scores)
+			Result.Scores.Add((float)Score->AsNumber());
+	}
+
+	Result.bSuccess = true;
+	return Result;
+}
+
+void FEvaluatorProcess::Complete(FRequest& Request, FEvaluationResult&& Result)
+{
+	if (!Request.OnComplete)
+		return;
+
+	AsyncTask(ENamedThreads::GameThread, [OnComplete = MoveTemp(Request.OnComplete), Result = MoveTemp(Result)]()
+	{
+		OnComplete(Result);
+	});
+}
@@ -0,0 +1,289 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Evaluation/QuickDrawBatchQueue.h"
+
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "CanvasArea.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/Paths.h"
+
+FQuickDrawBatchQueue::FQuickDrawBatchQueue(const TSharedRef<const FQuickDrawModel, ESPMode::ThreadSafe>& InModel, const FQuickDrawBatchSettings& InSettings)
+	: Model(InModel)
+	, Settings(InSettings)
+{
+	Settings.MaxBatchSize = FMath::Max(Settings.MaxBatchSize, 1);
+	Settings.MaxLengthRatio = FMath::Max(Settings.MaxLengthRatio, 1.0f);
+
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+	Thread = FRunnableThread::Create(this, TEXT("QuickDraw batch queue"), 0, TPri_Normal);
+}
+
+FQuickDrawBatchQueue::~FQuickDrawBatchQueue()
+{
+	if (Thread)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+}
+
+TSharedPtr<FQuickDrawBatchQueue, ESPMode::ThreadSafe> FQuickDrawBatchQueue::GetShared(const FString& ModelRootPath, const EQuickDrawPrecision Precision,
+	const FQuickDrawBatchSettings& Settings)
+{
+	check(IsInGameThread());
+
+	// Weak, so the queue and the model go away with the last canvas using them
+	static TMap<FString, TWeakPtr<FQuickDrawBatchQueue, ESPMode::ThreadSafe>> SharedQueues;
+	const FString Key = FPaths::ConvertRelativePathToFull(ModelRootPath) + FQuickDrawModel::GetWeightsSuffix(Precision);
+
+	if (TSharedPtr<FQuickDrawBatchQueue, ESPMode::ThreadSafe> Queue = SharedQueues.FindRef(Key).Pin())
+		return Queue;
+
+	TSharedRef<FQuickDrawModel, ESPMode::ThreadSafe> Model = MakeShared<FQuickDrawModel, ESPMode::ThreadSafe>();
+	if (!Model->Load(ModelRootPath, Precision))
+		return nullptr;
+
+	TSharedPtr<FQuickDrawBatchQueue, ESPMode::ThreadSafe> Queue = MakeShared<FQuickDrawBatchQueue, ESPMode::ThreadSafe>(Model, Settings);
+	SharedQueues.Add(Key, Queue);
+	return Queue;
+}
+
+void FQuickDrawBatchQueue::Evaluate(const FPainting& Painting, FOnEvaluationComplete&& OnComplete)
+{
+	FRequest Request;
+	Request.OnComplete = MoveTemp(OnComplete);
+	Request.QueueTime = FPlatformTime::Seconds();
+
+	// Nothing to batch for an empty canvas
+	if (FQuickDrawModel::MakeInput(Painting, Request.Ink) == 0)
+	{
+		Complete(Request, FEvaluationResult{ true, TEXT("Empty") });
+		return;
+	}
+
+	Requests.Enqueue(MoveTemp(Request));
+	WakeEvent->Trigger();
+}
+
+uint32 FQuickDrawBatchQueue::Run()
+{
+	TArray<FRequest> Pending;
+	while (!bStopping)
+	{
+		FRequest Request;
+		while (Requests.Dequeue(Request))
+			Pending.Add(MoveTemp(Request));
+
+		if (Pending.Num() == 0)
+		{
+			WakeEvent->Wait(FTimespan::FromMilliseconds(100));
+			continue;
+		}
+
+		// The oldest painting decides when the window closes, a full batch does not wait for it
+		const double WindowEnd = Pending[0].QueueTime + Settings.BatchWindowSeconds;
+		const double Now = FPlatformTime::Seconds();
+		if (Pending.Num() < Settings.MaxBatchSize && Now < WindowEnd)
+		{
+			WakeEvent->Wait(FTimespan::FromSeconds(WindowEnd - Now));
+			continue;
+		}
+
+		RunBatches(Pending);
+		Pending.Reset();
+	}
+
+	FRequest Request;
+	while (Requests.Dequeue(Request))
+		Pending.Add(MoveTemp(Request));
+
+	for (FRequest& Dropped : Pending)
+		Complete(Dropped, FEvaluationResult{ false, {}, {}, TEXT("The batch queue was shut down") });
+
+	return 0;
+}
+
+void FQuickDrawBatchQueue::Stop()
+{
+	bStopping = true;
+	WakeEvent->Trigger();
+}
+
+void FQuickDrawBatchQueue::RunBatches(TArray<FRequest>& Pending)
+{
+	// Similar lengths together, so short drawings do not sit in a batch that waits on a long one
+	Pending.Sort([](const FRequest& A, const FRequest& B) { return A.Ink.Num() < B.Ink.Num(); });
+
+	TArray<int32, TInlineAllocator<16>> BatchStarts;
+	for (int32 i = 0; i < Pending.Num(); ++i)
+	{
+		if (BatchStarts.Num() == 0)
+		{
+			BatchStarts.Add(i);
+			continue;
+		}
+
+		const int32 Start = BatchStarts.Last();
+		if (i - Start == Settings.MaxBatchSize || Pending[i].Ink.Num() > Pending[Start].Ink.Num() * Settings.MaxLengthRatio)
+			BatchStarts.Add(i);
+	}
+	BatchStarts.Add(Pending.Num());
+
+	// Batches of different lengths are independent, the model is only read
+	ParallelFor(BatchStarts.Num() - 1, [this, &Pending, &BatchStarts](const int32 Batch)
+	{
+		const int32 Start = BatchStarts[Batch];
+		const int32 End = BatchStarts[Batch + 1];
+
+		TArray<TArray<float>> Inks;
+		for (int32 i = Start; i < End; ++i)
+			Inks.Add(MoveTemp(Pending[i].Ink));
+
+		TArray<TArray<float>> Logits;
+		const bool bSuccess = Model->ForwardBatch(Inks, Logits);
+		for (int32 i = Start; i < End; ++i)
+		{
+			if (bSuccess)
+				Complete(Pending[i], Model->MakeResult(MoveTemp(Logits[i - Start])));
+			else
+				Complete(Pending[i], FEvaluationResult{ false, {}, {}, TEXT("The native forward pass failed") });
+		}
+
+		++NumBatches;
+		NumEvaluated += End - Start;
+	});
+}
+
+void FQuickDrawBatchQueue::Complete(FRequest& Request, FEvaluationResult&& Result) const
+{
+	if (!Request.OnComplete)
+		return;
+
+	if (!Settings.bCompleteOnGameThread)
+	{
+		Request.OnComplete(Result);
+		return;
+	}
+
+	AsyncTask(ENamedThreads::GameThread, [OnComplete = MoveTemp(Request.OnComplete), Result = MoveTemp(Result)]()
+	{
+		OnComplete(Result);
+	});
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	// Random walks of 40 to 160 points, in strokes of 20
+	void MakeBenchmarkPaintings(const int32 Count, TArray<FPainting>& OutPaintings)
+	{
+		FRandomStream Random(Count);
+		OutPaintings.SetNum(Count);
+		for (FPainting& Painting : OutPaintings)
+		{
+			const int32 NumPoints = Random.RandRange(40, 160);
+			FIntPoint Point(Random.RandRange(100, 900), Random.RandRange(100, 900));
+			for (int32 p = 0; p < NumPoints; ++p)
+			{
+				if (p % 20 == 0)
+					Painting.Strokes.AddDefaulted();
+
+				Point += FIntPoint(Random.RandRange(-12, 12), Random.RandRange(-12, 12));
+				Painting.Strokes.Last().AddPoint(Point.X, Point.Y);
+			}
+		}
+	}
+
+	// Every canvas confirms at the same time, Rounds times in a row
+	void RunBatchQueueBenchmark(const TArray<FString>& Args)
+	{
+		const FString ModelRoot = Args.Num() > 0 ? Args[0] : FPaths::ProjectDir() / TEXT("Evaluator/models/model_20250411_222609_1");
+		const int32 NumCanvases = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 8;
+		const int32 Rounds = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 20;
+
+		TSharedRef<FQuickDrawModel, ESPMode::ThreadSafe> Model = MakeShared<FQuickDrawModel, ESPMode::ThreadSafe>();
+		if (!Model->Load(ModelRoot))
+			return;
+
+		TArray<FPainting> Paintings;
+		MakeBenchmarkPaintings(NumCanvases * Rounds, Paintings);
+
+		FEvent* RoundDone = FPlatformProcess::GetSynchEventFromPool();
+		std::atomic<int32> Remaining = 0;
+		std::atomic<int64> LatencyMicroseconds = 0;
+
+		auto Finish = [&Remaining, &LatencyMicroseconds, RoundDone](const double SubmitTime)
+		{
+			LatencyMicroseconds += (int64)((FPlatformTime::Seconds() - SubmitTime) * 1000000.0);
+			if (--Remaining == 0)
+				RoundDone->Trigger();
+		};
+
+		auto Report = [NumCanvases, Rounds, &LatencyMicroseconds](const TCHAR* Name, const double Seconds)
+		{
+			const int32 NumPaintings = NumCanvases * Rounds;
+			UE_LOG(LogTemp, Display, TEXT("[FQuickDrawBatchQueue]   %s: %.2f ms per round, %.2f ms latency, %.1f paintings/s"), Name,
+				Seconds * 1000.0 / Rounds, LatencyMicroseconds / 1000.0 / NumPaintings, NumPaintings / Seconds);
+		};
+
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawBatchQueue] %d canvases, %d rounds"), NumCanvases, Rounds);
+
+		// One evaluation per painting on the thread pool, like every canvas did on its own
+		double Start = FPlatformTime::Seconds();
+		for (int32 Round = 0; Round < Rounds; ++Round)
+		{
+			Remaining = NumCanvases;
+			for (int32 c = 0; c < NumCanvases; ++c)
+			{
+				const FPainting* Painting = &Paintings[Round * NumCanvases + c];
+				Async(EAsyncExecution::ThreadPool, [Model, Painting, Finish, SubmitTime = FPlatformTime::Seconds()]()
+				{
+					Model->Evaluate(*Painting);
+					Finish(SubmitTime);
+				});
+			}
+
+			RoundDone->Wait();
+		}
+		Report(TEXT("Separate"), FPlatformTime::Seconds() - Start);
+
+		FQuickDrawBatchSettings Settings;
+		Settings.bCompleteOnGameThread = false;
+		FQuickDrawBatchQueue Queue(Model, Settings);
+
+		LatencyMicroseconds = 0;
+		Start = FPlatformTime::Seconds();
+		for (int32 Round = 0; Round < Rounds; ++Round)
+		{
+			Remaining = NumCanvases;
+			for (int32 c = 0; c < NumCanvases; ++c)
+			{
+				Queue.Evaluate(Paintings[Round * NumCanvases + c], [Finish, SubmitTime = FPlatformTime::Seconds()](const FEvaluationResult&)
+				{
+					Finish(SubmitTime);
+				});
+			}
+
+			RoundDone->Wait();
+		}
+		Report(TEXT("Batched"), FPlatformTime::Seconds() - Start);
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawBatchQueue]   %.2f paintings per batch"), (float)Queue.GetNumEvaluated() / FMath::Max(Queue.GetNumBatches(), 1));
+
+		FPlatformProcess::ReturnSynchEventToPool(RoundDone);
+	}
+
+	FAutoConsoleCommand BenchmarkBatchQueueCommand(
+		TEXT("SpeedArtist.Benchmark.BatchQueue"),
+		TEXT("Confirms paintings on many canvases at once, evaluated separately and through the batch queue. Args: [ModelRootPath] [Canvases] [Rounds]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunBatchQueueBenchmark));
+}
+
+#endif
@@ -0,0 +1,567 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Evaluation/QuickDrawKernels.h"
+
+#include <cmath>
+#include <type_traits>
+
+namespace
+{
+	constexpr int32 Lanes = FQuickDrawKernels::Lanes;
+	constexpr int32 NumGates = FQuickDrawKernels::NumGates;
+
+	// Floats per packed column of a gate block, the four gates of Lanes hidden units
+	constexpr int32 GateColumn = NumGates * Lanes;
+
+	// Rational approximation of tanh, within 3e-7 of std::tanh. Past the clamp the result rounds to +-1 in float.
+	FORCEINLINE VectorRegister4Float VectorFastTanh(const VectorRegister4Float Value)
+	{
+		const VectorRegister4Float Limit = VectorSetFloat1(7.90531110763549805f);
+		const VectorRegister4Float X = VectorMin(VectorMax(Value, VectorNegate(Limit)), Limit);
+		const VectorRegister4Float X2 = VectorMultiply(X, X);
+
+		VectorRegister4Float P = VectorMultiplyAdd(X2, VectorSetFloat1(-2.76076847742355e-16f), VectorSetFloat1(2.00018790482477e-13f));
+		P = VectorMultiplyAdd(P, X2, VectorSetFloat1(-8.60467152213735e-11f));
+		P = VectorMultiplyAdd(P, X2, VectorSetFloat1(5.12229709037114e-08f));
+		P = VectorMultiplyAdd(P, X2, VectorSetFloat1(1.48572235717979e-05f));
+		P = VectorMultiplyAdd(P, X2, VectorSetFloat1(6.37261928875436e-04f));
+		P = VectorMultiplyAdd(P, X2, VectorSetFloat1(4.89352455891786e-03f));
+		P = VectorMultiply(P, X);
+
+		VectorRegister4Float Q = VectorMultiplyAdd(X2, VectorSetFloat1(1.19825839466702e-06f), VectorSetFloat1(1.18534705686654e-04f));
+		Q = VectorMultiplyAdd(Q, X2, VectorSetFloat1(2.26843463243900e-03f));
+		Q = VectorMultiplyAdd(Q, X2, VectorSetFloat1(4.89352518554385e-03f));
+
+		return VectorDivide(P, Q);
+	}
+
+	// sigmoid(x) = (1 + tanh(x / 2)) / 2
+	FORCEINLINE VectorRegister4Float VectorFastSigmoid(const VectorRegister4Float Value)
+	{
+		const VectorRegister4Float Half = VectorSetFloat1(0.5f);
+		return VectorMultiplyAdd(VectorFastTanh(VectorMultiply(Value, Half)), Half, Half);
+	}
+
+	FORCEINLINE VectorRegister4Float LoadWeights(const float* Weights)
+	{
+		return VectorLoad(Weights);
+	}
+
+	FORCEINLINE VectorRegister4Float LoadWeights(const FFloat16* Weights)
+	{
+		return VectorLoadHalf(reinterpret_cast<const uint16*>(Weights));
+	}
+
+	FORCEINLINE VectorRegister4Float LoadWeights(const int8* Weights)
+	{
+		return VectorLoadSignedByte4(Weights);
+	}
+
+	FORCEINLINE float LoadWeight(const float Weight) { return Weight; }
+	FORCEINLINE float LoadWeight(const FFloat16 Weight) { return Weight.GetFloat(); }
+	FORCEINLINE float LoadWeight(const int8 Weight) { return (float)Weight; }
+
+	// Only int8 weights carry row scales
+	template <typename WeightType>
+	constexpr bool IsScaled()
+	{
+		return std::is_same_v<WeightType, int8>;
+	}
+
+	FORCEINLINE float Sigmoid(const float Value)
+	{
+		return 1.0f / (1.0f + std::exp(-Value));
+	}
+
+	// The accumulators of the four gates of one block of hidden units, spelled out so they stay in registers
+	struct FGateAccumulators
+	{
+		VectorRegister4Float Input;
+		VectorRegister4Float Forget;
+		VectorRegister4Float Cell;
+		VectorRegister4Float Output;
+
+		FORCEINLINE void Load(const float* Gates)
+		{
+			Input = VectorLoad(Gates);
+			Forget = VectorLoad(Gates + Lanes);
+			Cell = VectorLoad(Gates + 2 * Lanes);
+			Output = VectorLoad(Gates + 3 * Lanes);
+		}
+
+		FORCEINLINE void Store(float* Gates) const
+		{
+			VectorStore(Input, Gates);
+			VectorStore(Forget, Gates + Lanes);
+			VectorStore(Cell, Gates + 2 * Lanes);
+			VectorStore(Output, Gates + 3 * Lanes);
+		}
+
+		// One packed column of weights times one broadcast input
+		template <typename WeightType>
+		FORCEINLINE void Accumulate(const WeightType* Weights, const VectorRegister4Float Value)
+		{
+			Input = VectorMultiplyAdd(LoadWeights(Weights), Value, Input);
+			Forget = VectorMultiplyAdd(LoadWeights(Weights + Lanes), Value, Forget);
+			Cell = VectorMultiplyAdd(LoadWeights(Weights + 2 * Lanes), Value, Cell);
+			Output = VectorMultiplyAdd(LoadWeights(Weights + 3 * Lanes), Value, Output);
+		}
+
+		// Acc * Scales + Offsets, for the int8 weights
+		FORCEINLINE void ScaleAndAdd(const float* Scales, const float* Offsets)
+		{
+			Input = VectorMultiplyAdd(Input, VectorLoad(Scales), VectorLoad(Offsets));
+			Forget = VectorMultiplyAdd(Forget, VectorLoad(Scales + Lanes), VectorLoad(Offsets + Lanes));
+			Cell = VectorMultiplyAdd(Cell, VectorLoad(Scales + 2 * Lanes), VectorLoad(Offsets + 2 * Lanes));
+			Output = VectorMultiplyAdd(Output, VectorLoad(Scales + 3 * Lanes), VectorLoad(Offsets + 3 * Lanes));
+		}
+	};
+
+	// Acc += W x over Cols inputs, with a second set of accumulators so consecutive multiply-adds do not wait on each other
+	template <typename WeightType>
+	FORCEINLINE void AccumulateGates(const WeightType* Block, const int32 Cols, const float* X, FGateAccumulators& Acc)
+	{
+		FGateAccumulators Odd = { VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat() };
+
+		int32 j = 0;
+		for (; j + 2 <= Cols; j += 2)
+		{
+			Acc.Accumulate(Block + j * GateColumn, VectorLoadFloat1(X + j));
+			Odd.Accumulate(Block + (j + 1) * GateColumn, VectorLoadFloat1(X + j + 1));
+		}
+
+		if (j < Cols)
+			Acc.Accumulate(Block + j * GateColumn, VectorLoadFloat1(X + j));
+
+		Acc.Input = VectorAdd(Acc.Input, Odd.Input);
+		Acc.Forget = VectorAdd(Acc.Forget, Odd.Forget);
+		Acc.Cell = VectorAdd(Acc.Cell, Odd.Cell);
+		Acc.Output = VectorAdd(Acc.Output, Odd.Output);
+	}
+}
+
+void FQuickDrawKernels::PackConv(TConstArrayView<float> Weights, const int32 OutChannels, const int32 InChannels, const int32 KernelSize, TArray<float>& OutPacked)
+{
+	check(OutChannels % Lanes == 0 && Weights.Num() == OutChannels * InChannels * KernelSize);
+
+	OutPacked.SetNumUninitialized(Weights.Num());
+	float* Out = OutPacked.GetData();
+	for (int32 Block = 0; Block < OutChannels / Lanes; ++Block)
+		for (int32 k = 0; k < KernelSize; ++k)
+			for (int32 i = 0; i < InChannels; ++i)
+				for (int32 l = 0; l < Lanes; ++l)
+					*Out++ = Weights[((Block * Lanes + l) * InChannels + i) * KernelSize + k];
+}
+
+void FQuickDrawKernels::Conv1d(const float* Packed, const float* Bias, const int32 OutChannels, const int32 InChannels, const int32 KernelSize,
+	const float* PaddedInput, const int32 NumSteps, float* Output, const int32 OutputStride)
+{
+	constexpr int32 StepTile = 4;
+	const int32 BlockFloats = KernelSize * InChannels * Lanes;
+
+	// One block of weights (a few KB) stays in L1 while it runs over the whole drawing, 4 steps at a time
+	for (int32 Block = 0; Block < OutChannels / Lanes; ++Block)
+	{
+		const float* Weights = Packed + Block * BlockFloats;
+		const VectorRegister4Float BlockBias = VectorLoad(Bias + Block * Lanes);
+
+		int32 t = 0;
+		for (; t + StepTile <= NumSteps; t += StepTile)
+		{
+			VectorRegister4Float Acc[StepTile] = { BlockBias, BlockBias, BlockBias, BlockBias };
+			const float* W = Weights;
+			for (int32 k = 0; k < KernelSize; ++k)
+			{
+				const float* Row = PaddedInput + (t + k) * InChannels;
+				for (int32 i = 0; i < InChannels; ++i, W += Lanes)
+				{
+					const VectorRegister4Float Weight = VectorLoad(W);
+					for (int32 s = 0; s < StepTile; ++s)
+						Acc[s] = VectorMultiplyAdd(Weight, VectorLoadFloat1(Row + s * InChannels + i), Acc[s]);
+				}
+			}
+
+			for (int32 s = 0; s < StepTile; ++s)
+				VectorStore(Acc[s], Output + (t + s) * OutputStride + Block * Lanes);
+		}
+
+		for (; t < NumSteps; ++t)
+		{
+			VectorRegister4Float Acc = BlockBias;
+			const float* W = Weights;
+			for (int32 k = 0; k < KernelSize; ++k)
+			{
+				const float* Row = PaddedInput + (t + k) * InChannels;
+				for (int32 i = 0; i < InChannels; ++i, W += Lanes)
+					Acc = VectorMultiplyAdd(VectorLoad(W), VectorLoadFloat1(Row + i), Acc);
+			}
+
+			VectorStore(Acc, Output + t * OutputStride + Block * Lanes);
+		}
+	}
+}
+
+void FQuickDrawKernels::Conv1dReference(const float* Packed, const float* Bias, const int32 OutChannels, const int32 InChannels, const int32 KernelSize,
+	const float* PaddedInput, const int32 NumSteps, float* Output, const int32 OutputStride)
+{
+	for (int32 t = 0; t < NumSteps; ++t)
+	{
+		for (int32 o = 0; o < OutChannels; ++o)
+		{
+			const float* Weights = Packed + (o / Lanes) * KernelSize * InChannels * Lanes + o % Lanes;
+			float Sum = Bias[o];
+			for (int32 k = 0; k < KernelSize; ++k)
+				for (int32 i = 0; i < InChannels; ++i)
+					Sum += Weights[(k * InChannels + i) * Lanes] * PaddedInput[(t + k) * InChannels + i];
+
+			Output[t * OutputStride + o] = Sum;
+		}
+	}
+}
+
+int64 FQuickDrawGateWeights::GetAllocatedBytes() const
+{
+	return Float32.GetAllocatedSize() + Float16.GetAllocatedSize() + Int8.GetAllocatedSize() + Scales.GetAllocatedSize();
+}
+
+namespace
+{
+	template <typename WeightType>
+	void PackGateValues(TConstArrayView<WeightType> Weights, const int32 HiddenSize, const int32 Cols, TArray<WeightType>& OutPacked)
+	{
+		check(HiddenSize % Lanes == 0 && Weights.Num() == NumGates * HiddenSize * Cols);
+
+		OutPacked.SetNumUninitialized(Weights.Num());
+		WeightType* Out = OutPacked.GetData();
+		for (int32 Block = 0; Block < HiddenSize / Lanes; ++Block)
+			for (int32 j = 0; j < Cols; ++j)
+				for (int32 q = 0; q < NumGates; ++q)
+					for (int32 l = 0; l < Lanes; ++l)
+						*Out++ = Weights[(q * HiddenSize + Block * Lanes + l) * Cols + j];
+	}
+
+	// Acc0 += W x0 and Acc1 += W x1 with one load of every weight. Kept out of line so the eight accumulators
+	// get the registers to themselves, rather than sharing them with the activation constants of the caller.
+	template <typename WeightType>
+	FORCENOINLINE void AccumulateGatesPair(const WeightType* Block, const int32 Cols, const float* X0, const float* X1,
+		FGateAccumulators& Acc0, FGateAccumulators& Acc1)
+	{
+		FGateAccumulators A0 = Acc0;
+		FGateAccumulators A1 = Acc1;
+		for (int32 j = 0; j < Cols; ++j)
+		{
+			const WeightType* W = Block + j * GateColumn;
+			A0.Accumulate(W, VectorLoadFloat1(X0 + j));
+			A1.Accumulate(W, VectorLoadFloat1(X1 + j));
+		}
+
+		Acc0 = A0;
+		Acc1 = A1;
+	}
+
+	// Activations and cell update for the four gates of Lanes units, which are ready together
+	FORCEINLINE void FinishStep(const FGateAccumulators& Acc, float* Cell, float* NewHidden)
+	{
+		const VectorRegister4Float InputGate = VectorFastSigmoid(Acc.Input);
+		const VectorRegister4Float ForgetGate = VectorFastSigmoid(Acc.Forget);
+		const VectorRegister4Float CellGate = VectorFastTanh(Acc.Cell);
+		const VectorRegister4Float OutputGate = VectorFastSigmoid(Acc.Output);
+
+		const VectorRegister4Float NewCell = VectorMultiplyAdd(ForgetGate, VectorLoad(Cell), VectorMultiply(InputGate, CellGate));
+		VectorStore(NewCell, Cell);
+		VectorStore(VectorMultiply(OutputGate, VectorFastTanh(NewCell)), NewHidden);
+	}
+
+	template <typename WeightType>
+	void InputGatesImpl(const WeightType* Packed, const float* PackedScales, const float* PackedBias, const int32 HiddenSize, const int32 InputSize,
+		const float* Input, const int32 NumSteps, float* OutGates)
+	{
+		const int32 StepFloats = NumGates * HiddenSize;
+		const int32 BlockWeights = InputSize * GateColumn;
+
+		// Two steps share every weight load. A block is at most 16 KB, so it is read from memory once per drawing.
+		// Scaled weights start from zero and get the bias after their scale.
+		for (int32 Block = 0; Block < HiddenSize / Lanes; ++Block)
+		{
+			const WeightType* Weights = Packed + Block * BlockWeights;
+			const float* BlockBias = PackedBias + Block * GateColumn;
+
+			FGateAccumulators Initial = { VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat() };
+			if constexpr (!IsScaled<WeightType>())
+				Initial.Load(BlockBias);
+
+			int32 t = 0;
+			for (; t + 2 <= NumSteps; t += 2)
+			{
+				const float* X0 = Input + t * InputSize;
+				const float* X1 = X0 + InputSize;
+
+				FGateAccumulators Acc0 = Initial;
+				FGateAccumulators Acc1 = Initial;
+				for (int32 j = 0; j < InputSize; ++j)
+				{
+					const WeightType* W = Weights + j * GateColumn;
+					Acc0.Accumulate(W, VectorLoadFloat1(X0 + j));
+					Acc1.Accumulate(W, VectorLoadFloat1(X1 + j));
+				}
+
+				if constexpr (IsScaled<WeightType>())
+				{
+					Acc0.ScaleAndAdd(PackedScales + Block * GateColumn, BlockBias);
+					Acc1.ScaleAndAdd(PackedScales + Block * GateColumn, BlockBias);
+				}
+
+				Acc0.Store(OutGates + t * StepFloats + Block * GateColumn);
+				Acc1.Store(OutGates + (t + 1) * StepFloats + Block * GateColumn);
+			}
+
+			if (t < NumSteps)
+			{
+				FGateAccumulators Acc = Initial;
+				AccumulateGates(Weights, InputSize, Input + t * InputSize, Acc);
+				if constexpr (IsScaled<WeightType>())
+					Acc.ScaleAndAdd(PackedScales + Block * GateColumn, BlockBias);
+
+				Acc.Store(OutGates + t * StepFloats + Block * GateColumn);
+			}
+		}
+	}
+
+	template <typename WeightType>
+	void InputGatesReferenceImpl(const WeightType* Packed, const float* PackedScales, const float* PackedBias, const int32 HiddenSize, const int32 InputSize,
+		const float* Input, const int32 NumSteps, float* OutGates)
+	{
+		const int32 StepFloats = NumGates * HiddenSize;
+		for (int32 t = 0; t < NumSteps; ++t)
+		{
+			for (int32 g = 0; g < StepFloats; ++g)
+			{
+				const WeightType* Weights = Packed + (g / GateColumn) * InputSize * GateColumn + g % GateColumn;
+				float Sum = 0.0f;
+				for (int32 j = 0; j < InputSize; ++j)
+					Sum += LoadWeight(Weights[j * GateColumn]) * Input[t * InputSize + j];
+
+				OutGates[t * StepFloats + g] = (PackedScales != nullptr ? Sum * PackedScales[g] : Sum) + PackedBias[g];
+			}
+		}
+	}
+
+	template <typename WeightType>
+	void LstmStepImpl(const WeightType* Packed, const float* PackedScales, const int32 HiddenSize, const float* StepGates, const float* PrevHidden,
+		float* Cell, float* NewHidden)
+	{
+		for (int32 Block = 0; Block < HiddenSize / Lanes; ++Block)
+		{
+			FGateAccumulators Acc = { VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat() };
+			if constexpr (!IsScaled<WeightType>())
+				Acc.Load(StepGates + Block * GateColumn);
+
+			AccumulateGates(Packed + Block * HiddenSize * GateColumn, HiddenSize, PrevHidden, Acc);
+
+			if constexpr (IsScaled<WeightType>())
+				Acc.ScaleAndAdd(PackedScales + Block * GateColumn, StepGates + Block * GateColumn);
+
+			FinishStep(Acc, Cell + Block * Lanes, NewHidden + Block * Lanes);
+		}
+	}
+
+	template <typename WeightType>
+	void LstmStepBatchImpl(const WeightType* Packed, const float* PackedScales, const int32 HiddenSize, const int32 BatchSize,
+		const float* const* StepGates, const float* const* PrevHidden, float* const* Cells, float* const* NewHidden)
+	{
+		for (int32 Block = 0; Block < HiddenSize / Lanes; ++Block)
+		{
+			const WeightType* Weights = Packed + Block * HiddenSize * GateColumn;
+			const int32 GateOffset = Block * GateColumn;
+			const int32 UnitOffset = Block * Lanes;
+
+			// The block's weights stay in the L1 cache while every pair of sequences goes through them
+			int32 b = 0;
+			for (; b + 2 <= BatchSize; b += 2)
+			{
+				FGateAccumulators Acc0 = { VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat() };
+				FGateAccumulators Acc1 = Acc0;
+				if constexpr (!IsScaled<WeightType>())
+				{
+					Acc0.Load(StepGates[b] + GateOffset);
+					Acc1.Load(StepGates[b + 1] + GateOffset);
+				}
+
+				AccumulateGatesPair(Weights, HiddenSize, PrevHidden[b], PrevHidden[b + 1], Acc0, Acc1);
+
+				if constexpr (IsScaled<WeightType>())
+				{
+					Acc0.ScaleAndAdd(PackedScales + GateOffset, StepGates[b] + GateOffset);
+					Acc1.ScaleAndAdd(PackedScales + GateOffset, StepGates[b + 1] + GateOffset);
+				}
+
+				FinishStep(Acc0, Cells[b] + UnitOffset, NewHidden[b] + UnitOffset);
+				FinishStep(Acc1, Cells[b + 1] + UnitOffset, NewHidden[b + 1] + UnitOffset);
+			}
+
+			if (b < BatchSize)
+			{
+				FGateAccumulators Acc = { VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat() };
+				if constexpr (!IsScaled<WeightType>())
+					Acc.Load(StepGates[b] + GateOffset);
+
+				AccumulateGates(Weights, HiddenSize, PrevHidden[b], Acc);
+
+				if constexpr (IsScaled<WeightType>())
+					Acc.ScaleAndAdd(PackedScales + GateOffset, StepGates[b] + GateOffset);
+
+				FinishStep(Acc, Cells[b] + UnitOffset, NewHidden[b] + UnitOffset);
+			}
+		}
+	}
+
+	template <typename WeightType>
+	void LstmStepReferenceImpl(const WeightType* Packed, const float* PackedScales, const int32 HiddenSize, const float* StepGates, const float* PrevHidden,
+		float* Cell, float* NewHidden)
+	{
+		float Gates[GateColumn];
+		for (int32 Block = 0; Block < HiddenSize / Lanes; ++Block)
+		{
+			const WeightType* Weights = Packed + Block * HiddenSize * GateColumn;
+			for (int32 g = 0; g < GateColumn; ++g)
+			{
+				float Sum = 0.0f;
+				for (int32 j = 0; j < HiddenSize; ++j)
+					Sum += LoadWeight(Weights[j * GateColumn + g]) * PrevHidden[j];
+
+				const int32 Gate = Block * GateColumn + g;
+				Gates[g] = (PackedScales != nullptr ? Sum * PackedScales[Gate] : Sum) + StepGates[Gate];
+			}
+
+			for (int32 l = 0; l < Lanes; ++l)
+			{
+				const int32 Unit = Block * Lanes + l;
+				const float InputGate = Sigmoid(Gates[l]);
+				const float ForgetGate = Sigmoid(Gates[Lanes + l]);
+				const float CellGate = std::tanh(Gates[2 * Lanes + l]);
+				const float OutputGate = Sigmoid(Gates[3 * Lanes + l]);
+
+				Cell[Unit] = ForgetGate * Cell[Unit] + InputGate * CellGate;
+				NewHidden[Unit] = OutputGate * std::tanh(Cell[Unit]);
+			}
+		}
+	}
+}
+
+void FQuickDrawKernels::PackGates(TConstArrayView<float> Weights, const int32 HiddenSize, const int32 Cols, FQuickDrawGateWeights& OutPacked)
+{
+	OutPacked = FQuickDrawGateWeights();
+	OutPacked.Precision = EQuickDrawPrecision::Float32;
+	PackGateValues(Weights, HiddenSize, Cols, OutPacked.Float32);
+}
+
+void FQuickDrawKernels::PackGates(TConstArrayView<FFloat16> Weights, const int32 HiddenSize, const int32 Cols, FQuickDrawGateWeights& OutPacked)
+{
+	OutPacked = FQuickDrawGateWeights();
+	OutPacked.Precision = EQuickDrawPrecision::Float16;
+	PackGateValues(Weights, HiddenSize, Cols, OutPacked.Float16);
+}
+
+void FQuickDrawKernels::PackGates(TConstArrayView<int8> Weights, TConstArrayView<float> RowScales, const int32 HiddenSize, const int32 Cols, FQuickDrawGateWeights& OutPacked)
+{
+	OutPacked = FQuickDrawGateWeights();
+	OutPacked.Precision = EQuickDrawPrecision::Int8;
+	PackGateValues(Weights, HiddenSize, Cols, OutPacked.Int8);
+	PackGateBias(RowScales, HiddenSize, OutPacked.Scales);
+}
+
+void FQuickDrawKernels::PackGateBias(TConstArrayView<float> Bias, const int32 HiddenSize, TArray<float>& OutPacked)
+{
+	check(HiddenSize % Lanes == 0 && Bias.Num() == NumGates * HiddenSize);
+
+	OutPacked.SetNumUninitialized(Bias.Num());
+	float* Out = OutPacked.GetData();
+	for (int32 Block = 0; Block < HiddenSize / Lanes; ++Block)
+		for (int32 q = 0; q < NumGates; ++q)
+			for (int32 l = 0; l < Lanes; ++l)
+				*Out++ = Bias[q * HiddenSize + Block * Lanes + l];
+}
+
+void FQuickDrawKernels::InputGates(const FQuickDrawGateWeights& Packed, const float* PackedBias, const int32 HiddenSize, const int32 InputSize,
+	const float* Input, const int32 NumSteps, float* OutGates)
+{
+	switch (Packed.Precision)
+	{
+	case EQuickDrawPrecision::Float32:
+		InputGatesImpl(Packed.Float32.GetData(), nullptr, PackedBias, HiddenSize, InputSize, Input, NumSteps, OutGates);
+		break;
+	case EQuickDrawPrecision::Float16:
+		InputGatesImpl(Packed.Float16.GetData(), nullptr, PackedBias, HiddenSize, InputSize, Input, NumSteps, OutGates);
+		break;
+	case EQuickDrawPrecision::Int8:
+		InputGatesImpl(Packed.Int8.GetData(), Packed.Scales.GetData(), PackedBias, HiddenSize, InputSize, Input, NumSteps, OutGates);
+		break;
+	}
+}
+
+void FQuickDrawKernels::InputGatesReference(const FQuickDrawGateWeights& Packed, const float* PackedBias, const int32 HiddenSize, const int32 InputSize,
+	const float* Input, const int32 NumSteps, float* OutGates)
+{
+	switch (Packed.Precision)
+	{
+	case EQuickDrawPrecision::Float32:
+		InputGatesReferenceImpl(Packed.Float32.GetData(), nullptr, PackedBias, HiddenSize, InputSize, Input, NumSteps, OutGates);
+		break;
+	case EQuickDrawPrecision::Float16:
+		InputGatesReferenceImpl(Packed.Float16.GetData(), nullptr, PackedBias, HiddenSize, InputSize, Input, NumSteps, OutGates);
+		break;
+	case EQuickDrawPrecision::Int8:
+		InputGatesReferenceImpl(Packed.Int8.GetData(), Packed.Scales.GetData(), PackedBias, HiddenSize, InputSize, Input, NumSteps, OutGates);
+		break;
+	}
+}
+
+void FQuickDrawKernels::LstmStep(const FQuickDrawGateWeights& Packed, const int32 HiddenSize, const float* StepGates, const float* PrevHidden, float* Cell, float* NewHidden)
+{
+	switch (Packed.Precision)
+	{
+	case EQuickDrawPrecision::Float32:
+		LstmStepImpl(Packed.Float32.GetData(), nullptr, HiddenSize, StepGates, PrevHidden, Cell, NewHidden);
+		break;
+	case EQuickDrawPrecision::Float16:
+		LstmStepImpl(Packed.Float16.GetData(), nullptr, HiddenSize, StepGates, PrevHidden, Cell, NewHidden);
+		break;
+	case EQuickDrawPrecision::Int8:
+		LstmStepImpl(Packed.Int8.GetData(), Packed.Scales.GetData(), HiddenSize, StepGates, PrevHidden, Cell, NewHidden);
+		break;
+	}
+}
+
+void FQuickDrawKernels::LstmStepBatch(const FQuickDrawGateWeights& Packed, const int32 HiddenSize, const int32 BatchSize,
+	const float* const* StepGates, const float* const* PrevHidden, float* const* Cells, float* const* NewHidden)
+{
+	switch (Packed.Precision)
+	{
+	case EQuickDrawPrecision::Float32:
+		LstmStepBatchImpl(Packed.Float32.GetData(), nullptr, HiddenSize, BatchSize, StepGates, PrevHidden, Cells, NewHidden);
+		break;
+	case EQuickDrawPrecision::Float16:
+		LstmStepBatchImpl(Packed.Float16.GetData(), nullptr, HiddenSize, BatchSize, StepGates, PrevHidden, Cells, NewHidden);
+		break;
+	case EQuickDrawPrecision::Int8:
+		LstmStepBatchImpl(Packed.Int8.GetData(), Packed.Scales.GetData(), HiddenSize, BatchSize, StepGates, PrevHidden, Cells, NewHidden);
+		break;
+	}
+}
+
+void FQuickDrawKernels::LstmStepReference(const FQuickDrawGateWeights& Packed, const int32 HiddenSize, const float* StepGates, const float* PrevHidden, float* Cell, float* NewHidden)
+{
+	switch (Packed.Precision)
+	{
+	case EQuickDrawPrecision::Float32:
+		LstmStepReferenceImpl(Packed.Float32.GetData(), nullptr, HiddenSize, StepGates, PrevHidden, Cell, NewHidden);
+		break;
+	case EQuickDrawPrecision::Float16:
+		LstmStepReferenceImpl(Packed.Float16.GetData(), nullptr, HiddenSize, StepGates, PrevHidden, Cell, NewHidden);
+		break;
+	case EQuickDrawPrecision::Int8:
+		LstmStepReferenceImpl(Packed.Int8.GetData(), Packed.Scales.GetData(), HiddenSize, StepGates, PrevHidden, Cell, NewHidden);
+		break;
+	}
+}
@@ -0,0 +1,1012 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Evaluation/QuickDrawModel.h"
+
+#include "CanvasArea.h"
+#include "Dom/JsonObject.h"
+#include "Drawing/PaintingBinaryFormat.h"
+#include "Evaluation/QuickDrawKernels.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	// Only the array matching Precision is filled
+	struct FTensor
+	{
+		TArray<int32> Dims;
+		EQuickDrawPrecision Precision = EQuickDrawPrecision::Float32;
+		TArray<float> Values;
+		TArray<FFloat16> HalfValues;
+		TArray<int8> Int8Values;
+
+		// Int8 only, one per row (the first dimension)
+		TArray<float> RowScales;
+	};
+
+	class FWeightsReader
+	{
+	public:
+		explicit FWeightsReader(const TArray<uint8>& InBytes)
+			: Bytes(InBytes)
+		{
+		}
+
+		bool ReadUInt32(uint32& OutValue)
+		{
+			if (Offset + (int64)sizeof(uint32) > Bytes.Num())
+				return false;
+
+			FMemory::Memcpy(&OutValue, Bytes.GetData() + Offset, sizeof(uint32));
+			Offset += sizeof(uint32);
+			return true;
+		}
+
+		bool ReadBytes(void* Out, const int64 NumBytes)
+		{
+			if (NumBytes < 0 || Offset + NumBytes > Bytes.Num())
+				return false;
+
+			FMemory::Memcpy(Out, Bytes.GetData() + Offset, NumBytes);
+			Offset += NumBytes;
+			return true;
+		}
+
+	private:
+		const TArray<uint8>& Bytes;
+		int64 Offset = 0;
+	};
+
+	bool ReadTensors(const TArray<uint8>& Bytes, TMap<FString, FTensor>& OutTensors)
+	{
+		FWeightsReader Reader(Bytes);
+
+		uint32 Magic = 0, Version = 0, NumTensors = 0;
+		if (!Reader.ReadUInt32(Magic) || !Reader.ReadUInt32(Version) || !Reader.ReadUInt32(NumTensors))
+			return false;
+
+		if (Magic != FQuickDrawModel::WeightsMagic || Version < 1 || Version > FQuickDrawModel::WeightsVersion)
+			return false;
+
+		for (uint32 t = 0; t < NumTensors; ++t)
+		{
+			uint32 NameLength = 0;
+			if (!Reader.ReadUInt32(NameLength))
+				return false;
+
+			TArray<ANSICHAR> Name;
+			Name.SetNumZeroed(NameLength + 1);
+			if (!Reader.ReadBytes(Name.GetData(), NameLength))
+				return false;
+
+			// Same values as EQuickDrawPrecision
+			uint32 DataType = 0;
+			if (Version >= 2 && (!Reader.ReadUInt32(DataType) || DataType > (uint32)EQuickDrawPrecision::Int8))
+				return false;
+
+			uint32 NumDims = 0;
+			if (!Reader.ReadUInt32(NumDims) || NumDims > 4)
+				return false;
+
+			FTensor Tensor;
+			Tensor.Precision = (EQuickDrawPrecision)DataType;
+			int64 NumValues = 1;
+			for (uint32 d = 0; d < NumDims; ++d)
+			{
+				uint32 Dim = 0;
+				if (!Reader.ReadUInt32(Dim))
+					return false;
+
+				Tensor.Dims.Add((int32)Dim);
+				NumValues *= Dim;
+			}
+
+			// Sizes are checked against the file before allocating
+			if (NumValues > Bytes.Num())
+				return false;
+
+			bool bRead = false;
+			switch (Tensor.Precision)
+			{
+			case EQuickDrawPrecision::Float32:
+				Tensor.Values.SetNumUninitialized((int32)NumValues);
+				bRead = Reader.ReadBytes(Tensor.Values.GetData(), NumValues * sizeof(float));
+				break;
+			case EQuickDrawPrecision::Float16:
+				Tensor.HalfValues.SetNumUninitialized((int32)NumValues);
+				bRead = Reader.ReadBytes(Tensor.HalfValues.GetData(), NumValues * sizeof(FFloat16));
+				break;
+			case EQuickDrawPrecision::Int8:
+				if (NumDims == 0 || Tensor.Dims[0] > Bytes.Num())
+					return false;
+
+				Tensor.RowScales.SetNumUninitialized(Tensor.Dims[0]);
+				Tensor.Int8Values.SetNumUninitialized((int32)NumValues);
+				bRead = Reader.ReadBytes(Tensor.RowScales.GetData(), Tensor.Dims[0] * sizeof(float))
+					&& Reader.ReadBytes(Tensor.Int8Values.GetData(), NumValues);
+				break;
+			}
+
+			if (!bRead)
+				return false;
+
+			OutTensors.Add(UTF8_TO_TCHAR(Name.GetData()), MoveTemp(Tensor));
+		}
+
+		return true;
+	}
+
+	// Everything but the LSTM matrices is always stored as fp32
+	const FTensor* FindTensor(const TMap<FString, FTensor>& Tensors, const FString& Name, const TArray<int32>& Dims,
+		const EQuickDrawPrecision Precision = EQuickDrawPrecision::Float32)
+	{
+		const FTensor* Tensor = Tensors.Find(Name);
+		if (Tensor == nullptr || Tensor->Dims != Dims || Tensor->Precision != Precision)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[FQuickDrawModel] Missing or mismatched tensor %s"), *Name);
+			return nullptr;
+		}
+
+		return Tensor;
+	}
+
+	void PackGateTensor(const FTensor& Tensor, const int32 HiddenSize, const int32 Cols, FQuickDrawGateWeights& OutPacked)
+	{
+		switch (Tensor.Precision)
+		{
+		case EQuickDrawPrecision::Float32:
+			FQuickDrawKernels::PackGates(Tensor.Values, HiddenSize, Cols, OutPacked);
+			break;
+		case EQuickDrawPrecision::Float16:
+			FQuickDrawKernels::PackGates(Tensor.HalfValues, HiddenSize, Cols, OutPacked);
+			break;
+		case EQuickDrawPrecision::Int8:
+			FQuickDrawKernels::PackGates(Tensor.Int8Values, Tensor.RowScales, HiddenSize, Cols, OutPacked);
+			break;
+		}
+	}
+
+	FORCEINLINE float Dot(const float* A, const float* B, const int32 Count)
+	{
+		float Sum = 0.0f;
+		for (int32 i = 0; i < Count; ++i)
+			Sum += A[i] * B[i];
+
+		return Sum;
+	}
+}
+
+bool FQuickDrawModel::Load(const FString& ModelRootPath, const EQuickDrawPrecision InPrecision)
+{
+	bLoaded = false;
+
+	const FString WeightsPath = ModelRootPath + GetWeightsSuffix(InPrecision);
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *WeightsPath, FILEREAD_Silent))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[FQuickDrawModel] Could not read %s"), *WeightsPath);
+		return false;
+	}
+
+	TArray<FString> ClassLines;
+	if (!FFileHelper::LoadFileToStringArray(ClassLines, *(ModelRootPath + TEXT("_classes"))))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[FQuickDrawModel] Could not read %s_classes"), *ModelRootPath);
+		return false;
+	}
+
+	Classes.Reset();
+	for (const FString& Line : ClassLines)
+	{
+		const FString ClassName = Line.TrimStartAndEnd();
+		if (!ClassName.IsEmpty())
+			Classes.Add(ClassName);
+	}
+
+	TMap<FString, FTensor> Tensors;
+	if (!ReadTensors(Bytes, Tensors))
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FQuickDrawModel] %s is not a valid weights file"), *WeightsPath);
+		return false;
+	}
+
+	// nn.Sequential numbers the dropouts too, the convolutions are 0, 2 and 4
+	int32 InChannels = InputChannels;
+	for (int32 l = 0; l < NumConvLayers; ++l)
+	{
+		const FString Prefix = FString::Printf(TEXT("conv.%d."), l * 2);
+		const FTensor* Weight = Tensors.Find(Prefix + TEXT("weight"));
+		if (Weight == nullptr || Weight->Precision != EQuickDrawPrecision::Float32 || Weight->Dims.Num() != 3 || Weight->Dims[1] != InChannels
+			|| Weight->Dims[0] % FQuickDrawKernels::Lanes != 0 || Weight->Dims[2] % 2 == 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[FQuickDrawModel] Missing or mismatched tensor %sweight"), *Prefix);
+			return false;
+		}
+
+		FConv1d& Conv = Convs[l];
+		Conv.InChannels = InChannels;
+		Conv.OutChannels = Weight->Dims[0];
+		Conv.KernelSize = Weight->Dims[2];
+
+		const FTensor* Bias = FindTensor(Tensors, Prefix + TEXT("bias"), { Conv.OutChannels });
+		if (Bias == nullptr)
+			return false;
+
+		FQuickDrawKernels::PackConv(Weight->Values, Conv.OutChannels, Conv.InChannels, Conv.KernelSize, Conv.Weights);
+		Conv.Bias = Bias->Values;
+		InChannels = Conv.OutChannels;
+	}
+
+	// The LSTM matrices are the only quantized tensors, and the file decides their precision
+	const FTensor* FirstHidden = Tensors.Find(TEXT("lstm.weight_hh_l0"));
+	if (FirstHidden == nullptr || FirstHidden->Dims.Num() != 2 || FirstHidden->Dims[1] % FQuickDrawKernels::Lanes != 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[FQuickDrawModel] Missing tensor lstm.weight_hh_l0"));
+		return false;
+	}
+	HiddenSize = FirstHidden->Dims[1];
+	Precision = FirstHidden->Precision;
+
+	for (int32 l = 0; l < NumLstmLayers; ++l)
+	{
+		FLstmLayer& Layer = LstmLayers[l];
+		Layer.InputSize = l == 0 ? InChannels : 2 * HiddenSize;
+
+		for (int32 Direction = 0; Direction < 2; ++Direction)
+		{
+			const FString Suffix = FString::Printf(TEXT("_l%d%s"), l, Direction == 1 ? TEXT("_reverse") : TEXT(""));
+			const FTensor* InputWeights = FindTensor(Tensors, TEXT("lstm.weight_ih") + Suffix, { 4 * HiddenSize, Layer.InputSize }, Precision);
+			const FTensor* HiddenWeights = FindTensor(Tensors, TEXT("lstm.weight_hh") + Suffix, { 4 * HiddenSize, HiddenSize }, Precision);
+			const FTensor* InputBias = FindTensor(Tensors, TEXT("lstm.bias_ih") + Suffix, { 4 * HiddenSize });
+			const FTensor* HiddenBias = FindTensor(Tensors, TEXT("lstm.bias_hh") + Suffix, { 4 * HiddenSize });
+			if (InputWeights == nullptr || HiddenWeights == nullptr || InputBias == nullptr || HiddenBias == nullptr)
+				return false;
+
+			FLstmDirection& Weights = Layer.Directions[Direction];
+			PackGateTensor(*InputWeights, HiddenSize, Layer.InputSize, Weights.InputWeights);
+			PackGateTensor(*HiddenWeights, HiddenSize, HiddenSize, Weights.HiddenWeights);
+
+			// Both biases are always added together
+			TArray<float> Bias = InputBias->Values;
+			for (int32 i = 0; i < Bias.Num(); ++i)
+				Bias[i] += HiddenBias->Values[i];
+
+			FQuickDrawKernels::PackGateBias(Bias, HiddenSize, Weights.Bias);
+		}
+	}
+
+	const FTensor* FcWeight = FindTensor(Tensors, TEXT("fc.weight"), { Classes.Num(), 2 * HiddenSize });
+	const FTensor* FcBias = FindTensor(Tensors, TEXT("fc.bias"), { Classes.Num() });
+	if (FcWeight == nullptr || FcBias == nullptr)
+		return false;
+
+	Classifier.InFeatures = 2 * HiddenSize;
+	Classifier.OutFeatures = Classes.Num();
+	Classifier.Weights = FcWeight->Values;
+	Classifier.Bias = FcBias->Values;
+
+	bLoaded = true;
+	UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel] Loaded %s, %d classes, hidden size %d, %.2f MB of weights"),
+		*WeightsPath, Classes.Num(), HiddenSize, GetWeightBytes() / (1024.0 * 1024.0));
+	return true;
+}
+
+const TCHAR* FQuickDrawModel::GetWeightsSuffix(const EQuickDrawPrecision InPrecision)
+{
+	switch (InPrecision)
+	{
+	case EQuickDrawPrecision::Float16:
+		return TEXT(".fp16.weights");
+	case EQuickDrawPrecision::Int8:
+		return TEXT(".int8.weights");
+	default:
+		return TEXT(".weights");
+	}
+}
+
+int64 FQuickDrawModel::GetWeightBytes() const
+{
+	int64 Bytes = Classifier.Weights.GetAllocatedSize() + Classifier.Bias.GetAllocatedSize();
+	for (const FConv1d& Conv : Convs)
+		Bytes += Conv.Weights.GetAllocatedSize() + Conv.Bias.GetAllocatedSize();
+
+	for (const FLstmLayer& Layer : LstmLayers)
+	{
+		for (const FLstmDirection& Direction : Layer.Directions)
+			Bytes += Direction.InputWeights.GetAllocatedBytes() + Direction.HiddenWeights.GetAllocatedBytes() + Direction.Bias.GetAllocatedSize();
+	}
+
+	return Bytes;
+}
+
+void FQuickDrawModel::AppendStrokePoints(const FStroke& Stroke, TArray<float>& OutPoints, const int32 FirstPoint, const int32 EndPoint)
+{
+	const int32 First = OutPoints.Num();
+	const int32 End = FMath::Min(EndPoint, Stroke.Num());
+	for (int32 i = FirstPoint; i < End; ++i)
+	{
+		if (!Stroke.IsKept(i))
+			continue;
+
+		const FIntPoint Point = Stroke.GetPoint(i);
+		OutPoints.Add((float)Point.X);
+		OutPoints.Add((float)Point.Y);
+		OutPoints.Add(0.0f);
+	}
+
+	if (End == Stroke.Num() && OutPoints.Num() > First)
+		OutPoints.Last() = 1.0f;
+}
+
+int32 FQuickDrawModel::MakeInput(const FPainting& Painting, TArray<float>& OutInk)
+{
+	OutInk.Reset();
+
+	// Absolute points first
+	for (const FStroke& Stroke : Painting.Strokes)
+		AppendStrokePoints(Stroke, OutInk);
+
+	const int32 NumPoints = OutInk.Num() / InputChannels;
+	if (NumPoints < 2)
+	{
+		OutInk.Reset();
+		return 0;
+	}
+
+	// Size normalization to the bounding box, a flat axis is left unscaled
+	float Lower[2] = { OutInk[0], OutInk[1] };
+	float Upper[2] = { OutInk[0], OutInk[1] };
+	for (int32 p = 1; p < NumPoints; ++p)
+	{
+		for (int32 Axis = 0; Axis < 2; ++Axis)
+		{
+			Lower[Axis] = FMath::Min(Lower[Axis], OutInk[p * InputChannels + Axis]);
+			Upper[Axis] = FMath::Max(Upper[Axis], OutInk[p * InputChannels + Axis]);
+		}
+	}
+
+	for (int32 Axis = 0; Axis < 2; ++Axis)
+	{
+		const float Scale = Upper[Axis] - Lower[Axis] == 0.0f ? 1.0f : Upper[Axis] - Lower[Axis];
+		for (int32 p = 0; p < NumPoints; ++p)
+			OutInk[p * InputChannels + Axis] = (OutInk[p * InputChannels + Axis] - Lower[Axis]) / Scale;
+	}
+
+	// Deltas, the first point has none and is dropped
+	for (int32 p = NumPoints - 1; p > 0; --p)
+	{
+		OutInk[p * InputChannels + 0] -= OutInk[(p - 1) * InputChannels + 0];
+		OutInk[p * InputChannels + 1] -= OutInk[(p - 1) * InputChannels + 1];
+	}
+	OutInk.RemoveAt(0, InputChannels, EAllowShrinking::No);
+
+	return NumPoints - 1;
+}
+
+bool FQuickDrawModel::Forward(TConstArrayView<float> Ink, const int32 NumSteps, TArray<float>& OutLogits,
+	const bool bReferenceKernels, FTimings* OutTimings) const
+{
+	if (!bLoaded || NumSteps <= 0 || Ink.Num() != NumSteps * InputChannels)
+		return false;
+
+	// Reused by every forward pass on this thread
+	thread_local TArray<float> Current;
+	thread_local TArray<float> Next;
+
+	FTimings Timings;
+	double LayerStart = FPlatformTime::Seconds();
+	auto LapSeconds = [&LayerStart]()
+	{
+		const double Now = FPlatformTime::Seconds();
+		const double Elapsed = Now - LayerStart;
+		LayerStart = Now;
+		return Elapsed;
+	};
+
+	// Times its own layers, the lap restarts after them
+	RunConvolutions(Ink, NumSteps, Current, Next, bReferenceKernels, Timings.ConvSeconds);
+	LapSeconds();
+
+	for (int32 l = 0; l < NumLstmLayers; ++l)
+	{
+		Next.SetNumUninitialized(NumSteps * 2 * HiddenSize);
+		RunLstmDirection(LstmLayers[l], 0, Current.GetData(), NumSteps, Next.GetData(), bReferenceKernels);
+		RunLstmDirection(LstmLayers[l], 1, Current.GetData(), NumSteps, Next.GetData(), bReferenceKernels);
+		Swap(Current, Next);
+		Timings.LstmSeconds[l] = LapSeconds();
+	}
+
+	// A single drawing has no padding, so the mask keeps every step
+	const int32 Features = 2 * HiddenSize;
+	TArray<float, TInlineAllocator<256>> Summed;
+	Summed.SetNumZeroed(Features);
+	for (int32 t = 0; t < NumSteps; ++t)
+	{
+		const float* Row = Current.GetData() + t * Features;
+		for (int32 i = 0; i < Features; ++i)
+			Summed[i] += Row[i];
+	}
+
+	OutLogits.SetNumUninitialized(Classifier.OutFeatures);
+	for (int32 c = 0; c < Classifier.OutFeatures; ++c)
+		OutLogits[c] = Classifier.Bias[c] + Dot(Classifier.Weights.GetData() + c * Classifier.InFeatures, Summed.GetData(), Classifier.InFeatures);
+
+	Timings.HeadSeconds = LapSeconds();
+	if (OutTimings != nullptr)
+		*OutTimings = Timings;
+
+	return true;
+}
+
+void FQuickDrawModel::RunConvolutions(TConstArrayView<float> Ink, const int32 NumSteps, TArray<float>& Current, TArray<float>& Next,
+	const bool bReferenceKernels, double* OutSeconds) const
+{
+	double LayerStart = FPlatformTime::Seconds();
+
+	// Every convolution reads zero rows around the drawing, the padding is left in the buffer the previous layer writes to
+	const int32 FirstPadding = Convs[0].KernelSize / 2;
+	Current.SetNumUninitialized((NumSteps + Convs[0].KernelSize - 1) * InputChannels);
+	FMemory::Memzero(Current.GetData(), Current.Num() * sizeof(float));
+	FMemory::Memcpy(Current.GetData() + FirstPadding * InputChannels, Ink.GetData(), Ink.Num() * sizeof(float));
+
+	// Dropout is a no-op in eval mode, there are no activations between the convolutions
+	for (int32 l = 0; l < NumConvLayers; ++l)
+	{
+		const FConv1d& Conv = Convs[l];
+		const int32 NextKernelSize = l + 1 < NumConvLayers ? Convs[l + 1].KernelSize : 1;
+		const int32 NextPadding = NextKernelSize / 2;
+
+		Next.SetNumUninitialized((NumSteps + NextKernelSize - 1) * Conv.OutChannels);
+		FMemory::Memzero(Next.GetData(), NextPadding * Conv.OutChannels * sizeof(float));
+		FMemory::Memzero(Next.GetData() + (NextPadding + NumSteps) * Conv.OutChannels, (NextKernelSize - 1 - NextPadding) * Conv.OutChannels * sizeof(float));
+
+		float* Output = Next.GetData() + NextPadding * Conv.OutChannels;
+		if (bReferenceKernels)
+			FQuickDrawKernels::Conv1dReference(Conv.Weights.GetData(), Conv.Bias.GetData(), Conv.OutChannels, Conv.InChannels, Conv.KernelSize, Current.GetData(), NumSteps, Output, Conv.OutChannels);
+		else
+			FQuickDrawKernels::Conv1d(Conv.Weights.GetData(), Conv.Bias.GetData(), Conv.OutChannels, Conv.InChannels, Conv.KernelSize, Current.GetData(), NumSteps, Output, Conv.OutChannels);
+
+		Swap(Current, Next);
+		if (OutSeconds != nullptr)
+		{
+			const double Now = FPlatformTime::Seconds();
+			OutSeconds[l] = Now - LayerStart;
+			LayerStart = Now;
+		}
+	}
+}
+
+FEvaluationResult FQuickDrawModel::Evaluate(const FPainting& Painting) const
+{
+	FEvaluationResult Result;
+	if (!bLoaded)
+	{
+		Result.Error = TEXT("The native model is not loaded");
+		return Result;
+	}
+
+	TArray<float> Ink;
+	const int32 NumSteps = MakeInput(Painting, Ink);
+	if (NumSteps == 0)
+	{
+		Result.bSuccess = true;
+		Result.ClassName = TEXT("Empty");
+		return Result;
+	}
+
+	if (!Forward(Ink, NumSteps, Result.Scores))
+	{
+		Result.Error = TEXT("The native forward pass failed");
+		return Result;
+	}
+
+	return MakeResult(MoveTemp(Result.Scores));
+}
+
+FEvaluationResult FQuickDrawModel::MakeResult(TArray<float>&& Logits) const
+{
+	FEvaluationResult Result;
+	int32 Best = 0;
+	for (int32 c = 1; c < Logits.Num(); ++c)
+	{
+		if (Logits[c] > Logits[Best])
+			Best = c;
+	}
+
+	Result.bSuccess = true;
+	Result.ClassName = Classes[Best];
+	Result.Scores = MoveTemp(Logits);
+	return Result;
+}
+
+bool FQuickDrawModel::ForwardBatch(TConstArrayView<TArray<float>> Inks, TArray<TArray<float>>& OutLogits) const
+{
+	const int32 BatchSize = Inks.Num();
+	if (!bLoaded || BatchSize == 0)
+		return false;
+
+	for (const TArray<float>& Ink : Inks)
+	{
+		if (Ink.Num() == 0 || Ink.Num() % InputChannels != 0)
+			return false;
+	}
+
+	// Longest first, so the drawings still running at any step are the first ones
+	TArray<int32, TInlineAllocator<16>> Order;
+	for (int32 b = 0; b < BatchSize; ++b)
+		Order.Add(b);
+
+	Order.Sort([&Inks](const int32 A, const int32 B) { return Inks[A].Num() > Inks[B].Num(); });
+
+	// The drawings are laid out one after the other, without padding
+	TArray<int32, TInlineAllocator<16>> NumSteps;
+	TArray<int32, TInlineAllocator<16>> Offsets;
+	int32 TotalSteps = 0;
+	for (const int32 b : Order)
+	{
+		NumSteps.Add(Inks[b].Num() / InputChannels);
+		Offsets.Add(TotalSteps);
+		TotalSteps += NumSteps.Last();
+	}
+
+	thread_local TArray<float> Current;
+	thread_local TArray<float> Next;
+	thread_local TArray<float> LayerInput;
+	thread_local TArray<float> LayerOutput;
+
+	// The convolutions keep their weights in cache on their own, so they run one drawing at a time
+	const int32 ConvChannels = Convs[NumConvLayers - 1].OutChannels;
+	LayerInput.SetNumUninitialized(TotalSteps * ConvChannels);
+	for (int32 i = 0; i < BatchSize; ++i)
+	{
+		RunConvolutions(Inks[Order[i]], NumSteps[i], Current, Next, false, nullptr);
+		FMemory::Memcpy(LayerInput.GetData() + Offsets[i] * ConvChannels, Current.GetData(), NumSteps[i] * ConvChannels * sizeof(float));
+	}
+
+	for (int32 l = 0; l < NumLstmLayers; ++l)
+	{
+		LayerOutput.SetNumUninitialized(TotalSteps * 2 * HiddenSize);
+		RunLstmDirectionBatch(LstmLayers[l], 0, LayerInput.GetData(), NumSteps, Offsets, LayerOutput.GetData());
+		RunLstmDirectionBatch(LstmLayers[l], 1, LayerInput.GetData(), NumSteps, Offsets, LayerOutput.GetData());
+		Swap(LayerInput, LayerOutput);
+	}
+
+	// Each drawing only sums its own steps, which is what the mask does for a padded PyTorch batch
+	const int32 Features = 2 * HiddenSize;
+	TArray<float, TInlineAllocator<256>> Summed;
+	OutLogits.SetNum(BatchSize);
+	for (int32 i = 0; i < BatchSize; ++i)
+	{
+		Summed.SetNumZeroed(Features);
+		FMemory::Memzero(Summed.GetData(), Features * sizeof(float));
+		for (int32 t = Offsets[i]; t < Offsets[i] + NumSteps[i]; ++t)
+		{
+			const float* Row = LayerInput.GetData() + t * Features;
+			for (int32 f = 0; f < Features; ++f)
+				Summed[f] += Row[f];
+		}
+
+		TArray<float>& Logits = OutLogits[Order[i]];
+		Logits.SetNumUninitialized(Classifier.OutFeatures);
+		for (int32 c = 0; c < Classifier.OutFeatures; ++c)
+			Logits[c] = Classifier.Bias[c] + Dot(Classifier.Weights.GetData() + c * Classifier.InFeatures, Summed.GetData(), Classifier.InFeatures);
+	}
+
+	return true;
+}
+
+void FQuickDrawModel::RunLstmDirection(const FLstmLayer& Layer, const int32 Direction, const float* In, const int32 NumSteps, float* Out,
+	const bool bReferenceKernels) const
+{
+	const FLstmDirection& Weights = Layer.Directions[Direction];
+	const int32 H = HiddenSize;
+	const int32 StepGates = FQuickDrawKernels::NumGates * H;
+
+	// The input half of every gate does not depend on the previous step, so it is done for the whole drawing at once
+	thread_local TArray<float> InputGates;
+	InputGates.SetNumUninitialized(NumSteps * StepGates);
+	if (bReferenceKernels)
+		FQuickDrawKernels::InputGatesReference(Weights.InputWeights, Weights.Bias.GetData(), H, Layer.InputSize, In, NumSteps, InputGates.GetData());
+	else
+		FQuickDrawKernels::InputGates(Weights.InputWeights, Weights.Bias.GetData(), H, Layer.InputSize, In, NumSteps, InputGates.GetData());
+
+	thread_local TArray<float> Cell;
+	thread_local TArray<float> InitialHidden;
+	Cell.SetNumZeroed(H);
+	InitialHidden.SetNumZeroed(H);
+	FMemory::Memzero(Cell.GetData(), H * sizeof(float));
+
+	// The reverse direction reads the sequence back to front and writes the second half of every output row.
+	// Each step reads the hidden state the previous one left in the output.
+	const float* PrevHidden = InitialHidden.GetData();
+	for (int32 s = 0; s < NumSteps; ++s)
+	{
+		const int32 t = Direction == 0 ? s : NumSteps - 1 - s;
+		float* NewHidden = Out + t * 2 * H + Direction * H;
+		if (bReferenceKernels)
+			FQuickDrawKernels::LstmStepReference(Weights.HiddenWeights, H, InputGates.GetData() + t * StepGates, PrevHidden, Cell.GetData(), NewHidden);
+		else
+			FQuickDrawKernels::LstmStep(Weights.HiddenWeights, H, InputGates.GetData() + t * StepGates, PrevHidden, Cell.GetData(), NewHidden);
+
+		PrevHidden = NewHidden;
+	}
+}
+
+void FQuickDrawModel::RunLstmDirectionBatch(const FLstmLayer& Layer, const int32 Direction, const float* In, TConstArrayView<int32> NumSteps,
+	TConstArrayView<int32> Offsets, float* Out) const
+{
+	const FLstmDirection& Weights = Layer.Directions[Direction];
+	const int32 H = HiddenSize;
+	const int32 StepGates = FQuickDrawKernels::NumGates * H;
+	const int32 BatchSize = NumSteps.Num();
+	const int32 TotalSteps = Offsets.Last() + NumSteps.Last();
+
+	// Input gates do not care where one drawing ends and the next begins
+	thread_local TArray<float> InputGates;
+	InputGates.SetNumUninitialized(TotalSteps * StepGates);
+	FQuickDrawKernels::InputGates(Weights.InputWeights, Weights.Bias.GetData(), H, Layer.InputSize, In, TotalSteps, InputGates.GetData());
+
+	thread_local TArray<float> Cells;
+	thread_local TArray<float> InitialHidden;
+	Cells.SetNumZeroed(BatchSize * H);
+	InitialHidden.SetNumZeroed(H);
+	FMemory::Memzero(Cells.GetData(), BatchSize * H * sizeof(float));
+
+	TArray<const float*, TInlineAllocator<16>> StepGatesRows;
+	TArray<const float*, TInlineAllocator<16>> PrevHiddenRows;
+	TArray<float*, TInlineAllocator<16>> CellRows;
+	TArray<float*, TInlineAllocator<16>> NewHiddenRows;
+	StepGatesRows.SetNumUninitialized(BatchSize);
+	PrevHiddenRows.SetNumUninitialized(BatchSize);
+	CellRows.SetNumUninitialized(BatchSize);
+	NewHiddenRows.SetNumUninitialized(BatchSize);
+
+	// Every drawing runs from its own first or last step, so it gets the exact result it would get on its own.
+	// Shorter drawings drop out of the end of the batch as they finish.
+	int32 Active = BatchSize;
+	for (int32 s = 0; s < NumSteps[0]; ++s)
+	{
+		while (NumSteps[Active - 1] <= s)
+			--Active;
+
+		for (int32 i = 0; i < Active; ++i)
+		{
+			const int32 Row = Offsets[i] + (Direction == 0 ? s : NumSteps[i] - 1 - s);
+			const int32 PrevRow = Direction == 0 ? Row - 1 : Row + 1;
+
+			StepGatesRows[i] = InputGates.GetData() + Row * StepGates;
+			PrevHiddenRows[i] = s == 0 ? InitialHidden.GetData() : Out + PrevRow * 2 * H + Direction * H;
+			CellRows[i] = Cells.GetData() + i * H;
+			NewHiddenRows[i] = Out + Row * 2 * H + Direction * H;
+		}
+
+		FQuickDrawKernels::LstmStepBatch(Weights.HiddenWeights, H, Active, StepGatesRows.GetData(), PrevHiddenRows.GetData(), CellRows.GetData(), NewHiddenRows.GetData());
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	// A random walk with a stroke end every 20 points, in the shape MakeInput produces
+	void MakeBenchmarkInk(const int32 NumPoints, TArray<float>& OutInk)
+	{
+		FRandomStream Random(NumPoints);
+		OutInk.SetNumUninitialized((NumPoints - 1) * FQuickDrawModel::InputChannels);
+		for (int32 t = 0; t < NumPoints - 1; ++t)
+		{
+			OutInk[t * 3 + 0] = Random.FRandRange(-0.05f, 0.05f);
+			OutInk[t * 3 + 1] = Random.FRandRange(-0.05f, 0.05f);
+			OutInk[t * 3 + 2] = (t + 2) % 20 == 0 ? 1.0f : 0.0f;
+		}
+	}
+
+	void LogTimings(const TCHAR* Name, const FQuickDrawModel::FTimings& Timings, const int32 Iterations)
+	{
+		double TotalSeconds = Timings.HeadSeconds;
+		FString Layers;
+		for (int32 l = 0; l < FQuickDrawModel::NumConvLayers; ++l)
+		{
+			Layers += FString::Printf(TEXT(" conv%d %.3f"), l, Timings.ConvSeconds[l] * 1000.0 / Iterations);
+			TotalSeconds += Timings.ConvSeconds[l];
+		}
+		for (int32 l = 0; l < FQuickDrawModel::NumLstmLayers; ++l)
+		{
+			Layers += FString::Printf(TEXT(" lstm%d %.3f"), l, Timings.LstmSeconds[l] * 1000.0 / Iterations);
+			TotalSeconds += Timings.LstmSeconds[l];
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel]   %s: %.3f ms |%s head %.3f"), Name, TotalSeconds * 1000.0 / Iterations, *Layers, Timings.HeadSeconds * 1000.0 / Iterations);
+	}
+
+	EQuickDrawPrecision ParsePrecision(const FString& Name)
+	{
+		if (Name == TEXT("fp16"))
+			return EQuickDrawPrecision::Float16;
+		if (Name == TEXT("int8"))
+			return EQuickDrawPrecision::Int8;
+
+		return EQuickDrawPrecision::Float32;
+	}
+
+	void RunQuickDrawModelBenchmark(const TArray<FString>& Args)
+	{
+		const FString ModelRoot = Args.Num() > 0 ? Args[0] : FPaths::ProjectDir() / TEXT("Evaluator/models/model_20250411_222609_1");
+		const int32 Iterations = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 20;
+		const EQuickDrawPrecision Precision = ParsePrecision(Args.Num() > 2 ? Args[2] : TEXT("fp32"));
+
+		FQuickDrawModel Model;
+		if (!Model.Load(ModelRoot, Precision))
+			return;
+
+		// Single threaded, per layer averages in milliseconds
+		const int32 DrawingSizes[] = { 50, 200, 1000 };
+		TArray<float> Ink, Logits, ReferenceLogits;
+		for (const int32 NumPoints : DrawingSizes)
+		{
+			MakeBenchmarkInk(NumPoints, Ink);
+			const int32 NumSteps = NumPoints - 1;
+
+			FQuickDrawModel::FTimings Fast, Reference, Pass;
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				Model.Forward(Ink, NumSteps, ReferenceLogits, true, &Pass);
+				for (int32 l = 0; l < FQuickDrawModel::NumConvLayers; ++l)
+					Reference.ConvSeconds[l] += Pass.ConvSeconds[l];
+				for (int32 l = 0; l < FQuickDrawModel::NumLstmLayers; ++l)
+					Reference.LstmSeconds[l] += Pass.LstmSeconds[l];
+				Reference.HeadSeconds += Pass.HeadSeconds;
+
+				Model.Forward(Ink, NumSteps, Logits, false, &Pass);
+				for (int32 l = 0; l < FQuickDrawModel::NumConvLayers; ++l)
+					Fast.ConvSeconds[l] += Pass.ConvSeconds[l];
+				for (int32 l = 0; l < FQuickDrawModel::NumLstmLayers; ++l)
+					Fast.LstmSeconds[l] += Pass.LstmSeconds[l];
+				Fast.HeadSeconds += Pass.HeadSeconds;
+			}
+
+			float MaxDifference = 0.0f;
+			for (int32 c = 0; c < Logits.Num(); ++c)
+				MaxDifference = FMath::Max(MaxDifference, FMath::Abs(Logits[c] - ReferenceLogits[c]));
+
+			UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel] %d points, %d iterations, max logit difference %g"), NumPoints, Iterations, MaxDifference);
+			LogTimings(TEXT("Reference"), Reference, Iterations);
+			LogTimings(TEXT("Packed"), Fast, Iterations);
+		}
+	}
+
+	FAutoConsoleCommand BenchmarkQuickDrawModelCommand(
+		TEXT("SpeedArtist.Benchmark.QuickDrawModel"),
+		TEXT("Times every layer of the native model on 50, 200 and 1000 point drawings, packed against reference kernels. Args: [ModelRootPath] [Iterations] [fp32|fp16|int8]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunQuickDrawModelBenchmark));
+
+	struct FHeldOutDrawing
+	{
+		FString Word;
+		TArray<float> Ink;
+		int32 NumSteps = 0;
+	};
+
+	// Accuracy of the quantized variants against the fp32 model, on drawings it was not trained on
+	void RunQuantizationReport(const TArray<FString>& Args)
+	{
+		const FString ModelRoot = Args.Num() > 0 ? Args[0] : FPaths::ProjectDir() / TEXT("Evaluator/models/model_20250411_222609_1");
+		const FString HeldOutPath = Args.Num() > 1 ? Args[1] : FPaths::ProjectContentDir() / TEXT("PaintingHistory/Painting_0.ndjson");
+
+		TArray<FString> Lines;
+		if (!FFileHelper::LoadFileToStringArray(Lines, *HeldOutPath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("[FQuickDrawModel] Could not read %s"), *HeldOutPath);
+			return;
+		}
+
+		TArray<FHeldOutDrawing> Drawings;
+		for (const FString& Line : Lines)
+		{
+			FPaintingHeader Header;
+			FPainting Painting;
+			if (!FPaintingBinaryFormat::ParseNdjsonLine(Line, Header, Painting))
+				continue;
+
+			FHeldOutDrawing& Drawing = Drawings.AddDefaulted_GetRef();
+			Drawing.Word = Header.Word;
+			Drawing.NumSteps = FQuickDrawModel::MakeInput(Painting, Drawing.Ink);
+			if (Drawing.NumSteps == 0)
+				Drawings.Pop(EAllowShrinking::No);
+		}
+
+		FQuickDrawModel Baseline;
+		if (Drawings.Num() == 0 || !Baseline.Load(ModelRoot))
+			return;
+
+		TArray<TArray<float>> BaselineLogits;
+		for (const FHeldOutDrawing& Drawing : Drawings)
+			Baseline.Forward(Drawing.Ink, Drawing.NumSteps, BaselineLogits.AddDefaulted_GetRef());
+
+		auto ArgMax = [](const TArray<float>& Logits)
+		{
+			int32 Best = 0;
+			for (int32 c = 1; c < Logits.Num(); ++c)
+			{
+				if (Logits[c] > Logits[Best])
+					Best = c;
+			}
+			return Best;
+		};
+
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel] Quantization report, %d drawings from %s"), Drawings.Num(), *HeldOutPath);
+
+		const EQuickDrawPrecision Precisions[] = { EQuickDrawPrecision::Float32, EQuickDrawPrecision::Float16, EQuickDrawPrecision::Int8 };
+		TArray<float> Logits;
+		for (const EQuickDrawPrecision Precision : Precisions)
+		{
+			FQuickDrawModel Model;
+			if (!Model.Load(ModelRoot, Precision))
+				continue;
+
+			int32 NumCorrect = 0, NumAgreeing = 0;
+			float MaxDifference = 0.0f;
+			const double Start = FPlatformTime::Seconds();
+			for (int32 d = 0; d < Drawings.Num(); ++d)
+			{
+				Model.Forward(Drawings[d].Ink, Drawings[d].NumSteps, Logits);
+
+				const int32 Best = ArgMax(Logits);
+				NumCorrect += Model.GetClasses()[Best] == Drawings[d].Word ? 1 : 0;
+				NumAgreeing += Best == ArgMax(BaselineLogits[d]) ? 1 : 0;
+				for (int32 c = 0; c < Logits.Num(); ++c)
+					MaxDifference = FMath::Max(MaxDifference, FMath::Abs(Logits[c] - BaselineLogits[d][c]));
+			}
+			const double Seconds = FPlatformTime::Seconds() - Start;
+
+			UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel]   %s: %.2f MB, accuracy %.2f%%, agrees with fp32 on %.2f%%, max logit difference %g, %.1f drawings/s"),
+				FQuickDrawModel::GetWeightsSuffix(Precision), Model.GetWeightBytes() / (1024.0 * 1024.0),
+				100.0 * NumCorrect / Drawings.Num(), 100.0 * NumAgreeing / Drawings.Num(), MaxDifference, Drawings.Num() / Seconds);
+		}
+	}
+
+	FAutoConsoleCommand QuantizationReportCommand(
+		TEXT("SpeedArtist.Model.QuantizationReport"),
+		TEXT("Compares the fp16 and int8 models with the fp32 one on held-out drawings. Args: [ModelRootPath] [HeldOutNdjsonPath]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunQuantizationReport));
+
+	struct FParityDrawing
+	{
+		TArray<float> Ink;
+		int32 NumSteps = 0;
+		TArray<float> Expected;
+	};
+
+	// Checks the forward passes against the logits PyTorch wrote with Evaluator/ExportModel.py: the packed kernels, the
+	// reference kernels and the batched pass the native queue uses
+	void RunModelParity(const TArray<FString>& Args)
+	{
+		const FString ModelRoot = Args.Num() > 0 ? Args[0] : FPaths::ProjectDir() / TEXT("Evaluator/models/model_20250411_222609_1");
+		const FString ParityPath = Args.Num() > 1 ? Args[1] : ModelRoot + TEXT("_parity.ndjson");
+		const int32 BatchSize = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 8;
+
+		FQuickDrawModel Model;
+		if (!Model.Load(ModelRoot))
+			return;
+
+		TArray<FString> Lines;
+		if (!FFileHelper::LoadFileToStringArray(Lines, *ParityPath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("[FQuickDrawModel] Could not read %s"), *ParityPath);
+			return;
+		}
+
+		TArray<FParityDrawing> Drawings;
+		for (const FString& Line : Lines)
+		{
+			TSharedPtr<FJsonObject> Object;
+			const TArray<TSharedPtr<FJsonValue>>* Expected = nullptr;
+			if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Line), Object) || !Object.IsValid()
+				|| !Object->TryGetArrayField(TEXT("logits"), Expected))
+				continue;
+
+			FPaintingHeader Header;
+			FPainting Painting;
+			if (!FPaintingBinaryFormat::ParseNdjsonLine(Line, Header, Painting))
+				continue;
+
+			// ExportModel.py skips the drawings without a step too
+			FParityDrawing& Drawing = Drawings.AddDefaulted_GetRef();
+			Drawing.NumSteps = FQuickDrawModel::MakeInput(Painting, Drawing.Ink);
+			if (Drawing.NumSteps == 0)
+			{
+				Drawings.Pop(EAllowShrinking::No);
+				continue;
+			}
+
+			for (const TSharedPtr<FJsonValue>& Value : *Expected)
+				Drawing.Expected.Add((float)Value->AsNumber());
+		}
+
+		constexpr float AbsoluteTolerance = 1e-3f;
+		constexpr float RelativeTolerance = 1e-3f;
+
+		auto ArgMax = [](TConstArrayView<float> Logits)
+		{
+			int32 Best = 0;
+			for (int32 c = 1; c < Logits.Num(); ++c)
+			{
+				if (Logits[c] > Logits[Best])
+					Best = c;
+			}
+			return Best;
+		};
+
+		bool bAllPassed = Drawings.Num() > 0;
+		auto Report = [&](const TCHAR* Name, TConstArrayView<TArray<float>> AllLogits)
+		{
+			int32 NumFailed = 0, NumArgmaxMismatches = 0;
+			float MaxDifference = 0.0f;
+			for (int32 d = 0; d < Drawings.Num(); ++d)
+			{
+				const TArray<float>& Logits = AllLogits[d];
+				const TArray<float>& Expected = Drawings[d].Expected;
+				if (Logits.Num() != Expected.Num())
+				{
+					++NumFailed;
+					continue;
+				}
+
+				bool bPassed = true;
+				for (int32 c = 0; c < Logits.Num(); ++c)
+				{
+					const float Difference = FMath::Abs(Logits[c] - Expected[c]);
+					MaxDifference = FMath::Max(MaxDifference, Difference);
+					bPassed &= Difference <= AbsoluteTolerance + RelativeTolerance * FMath::Abs(Expected[c]);
+				}
+
+				NumFailed += bPassed ? 0 : 1;
+				NumArgmaxMismatches += ArgMax(Logits) == ArgMax(Expected) ? 0 : 1;
+			}
+
+			bAllPassed &= NumFailed == 0;
+			UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel]   %s: %d outside tolerance, %d different predictions, max logit difference %g"),
+				Name, NumFailed, NumArgmaxMismatches, MaxDifference);
+		};
+
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel] Parity with PyTorch, %d drawings from %s"), Drawings.Num(), *ParityPath);
+
+		TArray<TArray<float>> AllLogits;
+		AllLogits.SetNum(Drawings.Num());
+		for (int32 d = 0; d < Drawings.Num(); ++d)
+			Model.Forward(Drawings[d].Ink, Drawings[d].NumSteps, AllLogits[d]);
+		Report(TEXT("Packed"), AllLogits);
+
+		for (int32 d = 0; d < Drawings.Num(); ++d)
+			Model.Forward(Drawings[d].Ink, Drawings[d].NumSteps, AllLogits[d], true);
+		Report(TEXT("Reference"), AllLogits);
+
+		// In batches of consecutive drawings, like the queue gathers them
+		TArray<TArray<float>> BatchInks, BatchLogits;
+		for (int32 First = 0; First < Drawings.Num(); First += BatchSize)
+		{
+			BatchInks.Reset();
+			for (int32 d = First; d < FMath::Min(First + BatchSize, Drawings.Num()); ++d)
+				BatchInks.Add(Drawings[d].Ink);
+
+			BatchLogits.Reset();
+			Model.ForwardBatch(BatchInks, BatchLogits);
+			for (int32 i = 0; i < BatchInks.Num(); ++i)
+				AllLogits[First + i] = i < BatchLogits.Num() ? MoveTemp(BatchLogits[i]) : TArray<float>();
+		}
+		Report(TEXT("Batched"), AllLogits);
+
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawModel] Parity %s"), bAllPassed ? TEXT("PASS") : TEXT("FAIL"));
+	}
+
+	FAutoConsoleCommand ModelParityCommand(
+		TEXT("SpeedArtist.Model.Parity"),
+		TEXT("Compares the native QuickDrawRNN with PyTorch, one drawing at a time with both kernels and in batches. Args: [ModelRootPath] [ParityNdjsonPath] [BatchSize]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunModelParity));
+}
+
+#endif
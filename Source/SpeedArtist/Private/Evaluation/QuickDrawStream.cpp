@@ -0,0 +1,364 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Evaluation/QuickDrawStream.h"
+
+#include "CanvasArea.h"
+#include "Drawing/PaintingBinaryFormat.h"
+#include "Evaluation/QuickDrawKernels.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	constexpr int32 InputChannels = FQuickDrawModel::InputChannels;
+
+	// Zero rows around NumSteps rows of data, like FQuickDrawModel::Forward lays out every convolution input.
+	// The rows already there are kept.
+	void ResizePadded(TArray<float>& Buffer, const int32 NumSteps, const int32 KernelSize, const int32 Channels)
+	{
+		const int32 Padding = KernelSize / 2;
+		Buffer.SetNumZeroed((NumSteps + KernelSize - 1) * Channels);
+		FMemory::Memzero(Buffer.GetData() + (Padding + NumSteps) * Channels, (KernelSize - 1 - Padding) * Channels * sizeof(float));
+	}
+}
+
+FQuickDrawStream::FQuickDrawStream(const TSharedRef<const FQuickDrawModel, ESPMode::ThreadSafe>& InModel, const int32 InBackwardWindow, const float InRenormalizeFraction)
+	: Model(InModel)
+	, BackwardWindow(FMath::Max(InBackwardWindow, 1))
+	, RenormalizeFraction(FMath::Max(InRenormalizeFraction, 0.0f))
+{
+}
+
+void FQuickDrawStream::Reset()
+{
+	Points.Reset();
+	NumSteps = 0;
+	bNormalized = false;
+	NumBoxPoints = 0;
+	LastRecomputedSteps = 0;
+
+	for (TArray<float>& Buffer : ConvInputs)
+		Buffer.Reset();
+}
+
+bool FQuickDrawStream::Update(const int32 NumKeptPoints, TConstArrayView<float> NewPoints, TArray<float>& OutLogits)
+{
+	// Only the replaced points are compared, the first one that moved or changed its stroke end flag is usually the old last point
+	const int32 Kept = FMath::Clamp(NumKeptPoints, 0, GetNumPoints()) * InputChannels;
+	const int32 NumCommon = FMath::Min(Points.Num() - Kept, NewPoints.Num());
+	int32 NumSame = 0;
+	while (NumSame < NumCommon && Points[Kept + NumSame] == NewPoints[NumSame])
+		++NumSame;
+
+	const bool bChanged = NumSame < NewPoints.Num() || Points.Num() != Kept + NewPoints.Num();
+	const int32 FirstChanged = (Kept + NumSame) / InputChannels;
+
+	Points.SetNum(Kept, EAllowShrinking::No);
+	Points.Append(NewPoints.GetData(), NewPoints.Num());
+
+	// Too few points keep theirs for the next update, everything else starts over
+	if (!Model->IsLoaded() || GetNumPoints() < 2)
+	{
+		NumSteps = 0;
+		bNormalized = false;
+		LastRecomputedSteps = 0;
+		return false;
+	}
+
+	if (!bChanged && NumSteps > 0)
+		return false;
+
+	const int32 FirstStep = UpdateInput(Kept / InputChannels, FirstChanged);
+
+	// A convolution output depends on KernelSize / 2 inputs to its right
+	int32 Dirty = FirstStep;
+	for (int32 l = 0; l < FQuickDrawModel::NumConvLayers; ++l)
+	{
+		const FQuickDrawModel::FConv1d& Conv = Model->Convs[l];
+		Dirty = FMath::Max(0, Dirty - Conv.KernelSize / 2);
+
+		float* Output;
+		if (l + 1 < FQuickDrawModel::NumConvLayers)
+		{
+			const int32 NextKernelSize = Model->Convs[l + 1].KernelSize;
+			ResizePadded(ConvInputs[l + 1], NumSteps, NextKernelSize, Conv.OutChannels);
+			Output = ConvInputs[l + 1].GetData() + NextKernelSize / 2 * Conv.OutChannels;
+		}
+		else
+		{
+			LstmInput.SetNumUninitialized(NumSteps * Conv.OutChannels);
+			Output = LstmInput.GetData();
+		}
+
+		FQuickDrawKernels::Conv1d(Conv.Weights.GetData(), Conv.Bias.GetData(), Conv.OutChannels, Conv.InChannels, Conv.KernelSize,
+			ConvInputs[l].GetData() + Dirty * Conv.InChannels, NumSteps - Dirty, Output + Dirty * Conv.OutChannels, Conv.OutChannels);
+	}
+
+	// Each layer's backward half changes from where it restarted, and so does the input of the next layer
+	LastRecomputedSteps = 0;
+	for (int32 l = 0; l < FQuickDrawModel::NumLstmLayers; ++l)
+	{
+		const int32 BackwardStart = FirstStep == 0 ? 0 : FMath::Min(Dirty, FMath::Max(0, NumSteps - BackwardWindow));
+		RunLstmLayer(l, Dirty, BackwardStart);
+		Dirty = BackwardStart;
+	}
+
+	// The sums before the first recomputed row still hold, and they add up in the same order as a full pass
+	const FQuickDrawModel::FLinear& Classifier = Model->Classifier;
+	const int32 NumFeatures = Classifier.InFeatures;
+	const TArray<float>& Features = LstmOutputs[FQuickDrawModel::NumLstmLayers - 1];
+	FeatureSums.SetNumUninitialized((NumSteps + 1) * NumFeatures);
+	FMemory::Memzero(FeatureSums.GetData(), NumFeatures * sizeof(float));
+	for (int32 t = Dirty; t < NumSteps; ++t)
+	{
+		const float* Row = Features.GetData() + t * NumFeatures;
+		const float* Sum = FeatureSums.GetData() + t * NumFeatures;
+		float* NextSum = FeatureSums.GetData() + (t + 1) * NumFeatures;
+		for (int32 i = 0; i < NumFeatures; ++i)
+			NextSum[i] = Sum[i] + Row[i];
+	}
+
+	const float* Summed = FeatureSums.GetData() + NumSteps * NumFeatures;
+
+	OutLogits.SetNumUninitialized(Classifier.OutFeatures);
+	for (int32 c = 0; c < Classifier.OutFeatures; ++c)
+	{
+		const float* Weights = Classifier.Weights.GetData() + c * NumFeatures;
+		float Sum = 0.0f;
+		for (int32 i = 0; i < NumFeatures; ++i)
+			Sum += Weights[i] * Summed[i];
+
+		OutLogits[c] = Classifier.Bias[c] + Sum;
+	}
+
+	return true;
+}
+
+int32 FQuickDrawStream::UpdateInput(const int32 NumKeptPoints, const int32 FirstChangedPoint)
+{
+	const int32 NumPoints = GetNumPoints();
+	NumSteps = NumPoints - 1;
+
+	// The box of the kept points only grows by the ones kept for the first time, the replaced points are added on top
+	if (NumKeptPoints < NumBoxPoints)
+		NumBoxPoints = 0;
+
+	if (NumBoxPoints == 0)
+	{
+		for (int32 Axis = 0; Axis < 2; ++Axis)
+		{
+			BoxLower[Axis] = MAX_flt;
+			BoxUpper[Axis] = -MAX_flt;
+		}
+	}
+
+	auto Extend = [this](float* InOutLower, float* InOutUpper, const int32 Start, const int32 End)
+	{
+		for (int32 p = Start; p < End; ++p)
+		{
+			for (int32 Axis = 0; Axis < 2; ++Axis)
+			{
+				InOutLower[Axis] = FMath::Min(InOutLower[Axis], Points[p * InputChannels + Axis]);
+				InOutUpper[Axis] = FMath::Max(InOutUpper[Axis], Points[p * InputChannels + Axis]);
+			}
+		}
+	};
+
+	Extend(BoxLower, BoxUpper, NumBoxPoints, NumKeptPoints);
+	NumBoxPoints = NumKeptPoints;
+
+	float NewLower[2] = { BoxLower[0], BoxLower[1] };
+	float NewUpper[2] = { BoxUpper[0], BoxUpper[1] };
+	Extend(NewLower, NewUpper, NumKeptPoints, NumPoints);
+
+	// Every input depends on the box, so it only moves when the drawing has clearly outgrown it
+	bool bRenormalize = !bNormalized;
+	for (int32 Axis = 0; Axis < 2; ++Axis)
+	{
+		const float Tolerance = RenormalizeFraction * FMath::Max(Upper[Axis] - Lower[Axis], 1.0f);
+		bRenormalize |= FMath::Abs(NewLower[Axis] - Lower[Axis]) > Tolerance || FMath::Abs(NewUpper[Axis] - Upper[Axis]) > Tolerance;
+	}
+
+	int32 FirstStep = FMath::Min(FMath::Max(0, FirstChangedPoint - 1), NumSteps);
+	if (bRenormalize)
+	{
+		for (int32 Axis = 0; Axis < 2; ++Axis)
+		{
+			Lower[Axis] = NewLower[Axis];
+			Upper[Axis] = NewUpper[Axis];
+			Scale[Axis] = NewUpper[Axis] - NewLower[Axis] == 0.0f ? 1.0f : NewUpper[Axis] - NewLower[Axis];
+		}
+
+		bNormalized = true;
+		FirstStep = 0;
+	}
+
+	// Same arithmetic as FQuickDrawModel::MakeInput, written straight into the padded input of the first convolution
+	const int32 KernelSize = Model->Convs[0].KernelSize;
+	ResizePadded(ConvInputs[0], NumSteps, KernelSize, InputChannels);
+	float* Input = ConvInputs[0].GetData() + KernelSize / 2 * InputChannels;
+	for (int32 t = FirstStep; t < NumSteps; ++t)
+	{
+		const float* Prev = Points.GetData() + t * InputChannels;
+		const float* Next = Prev + InputChannels;
+		for (int32 Axis = 0; Axis < 2; ++Axis)
+			Input[t * InputChannels + Axis] = (Next[Axis] - Lower[Axis]) / Scale[Axis] - (Prev[Axis] - Lower[Axis]) / Scale[Axis];
+
+		Input[t * InputChannels + 2] = Next[2];
+	}
+
+	return FirstStep;
+}
+
+void FQuickDrawStream::RunLstmLayer(const int32 Layer, const int32 FirstStep, const int32 BackwardStart)
+{
+	const FQuickDrawModel::FLstmLayer& Weights = Model->LstmLayers[Layer];
+	const int32 H = Model->HiddenSize;
+	const int32 StepGates = FQuickDrawKernels::NumGates * H;
+	const float* In = Layer == 0 ? LstmInput.GetData() : LstmOutputs[Layer - 1].GetData();
+
+	TArray<float>& Out = LstmOutputs[Layer];
+	TArray<float>& Cells = ForwardCells[Layer];
+	Out.SetNumUninitialized(NumSteps * 2 * H);
+	Cells.SetNumUninitialized(NumSteps * H);
+	Gates.SetNumUninitialized((NumSteps - FMath::Min(FirstStep, BackwardStart)) * StepGates);
+	Cell.SetNumUninitialized(H);
+	ZeroHidden.SetNumZeroed(H);
+
+	// Forward, resumed from the state after the last step that did not change
+	const FQuickDrawModel::FLstmDirection& Forward = Weights.Directions[0];
+	FQuickDrawKernels::InputGates(Forward.InputWeights, Forward.Bias.GetData(), H, Weights.InputSize, In + FirstStep * Weights.InputSize, NumSteps - FirstStep, Gates.GetData());
+
+	const float* PrevHidden = ZeroHidden.GetData();
+	if (FirstStep > 0)
+	{
+		PrevHidden = Out.GetData() + (FirstStep - 1) * 2 * H;
+		FMemory::Memcpy(Cell.GetData(), Cells.GetData() + (FirstStep - 1) * H, H * sizeof(float));
+	}
+	else
+	{
+		FMemory::Memzero(Cell.GetData(), H * sizeof(float));
+	}
+
+	for (int32 t = FirstStep; t < NumSteps; ++t)
+	{
+		float* NewHidden = Out.GetData() + t * 2 * H;
+		FQuickDrawKernels::LstmStep(Forward.HiddenWeights, H, Gates.GetData() + (t - FirstStep) * StepGates, PrevHidden, Cell.GetData(), NewHidden);
+		FMemory::Memcpy(Cells.GetData() + t * H, Cell.GetData(), H * sizeof(float));
+		PrevHidden = NewHidden;
+	}
+
+	// Backward, from an empty state at the current end of the drawing
+	const FQuickDrawModel::FLstmDirection& Backward = Weights.Directions[1];
+	FQuickDrawKernels::InputGates(Backward.InputWeights, Backward.Bias.GetData(), H, Weights.InputSize, In + BackwardStart * Weights.InputSize, NumSteps - BackwardStart, Gates.GetData());
+
+	PrevHidden = ZeroHidden.GetData();
+	FMemory::Memzero(Cell.GetData(), H * sizeof(float));
+	for (int32 t = NumSteps - 1; t >= BackwardStart; --t)
+	{
+		float* NewHidden = Out.GetData() + t * 2 * H + H;
+		FQuickDrawKernels::LstmStep(Backward.HiddenWeights, H, Gates.GetData() + (t - BackwardStart) * StepGates, PrevHidden, Cell.GetData(), NewHidden);
+		PrevHidden = NewHidden;
+	}
+
+	LastRecomputedSteps += (NumSteps - FirstStep) + (NumSteps - BackwardStart);
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+	// Replays held-out drawings a few points at a time, as if they were being drawn
+	void RunLivePredictionBenchmark(const TArray<FString>& Args)
+	{
+		const FString ModelRoot = Args.Num() > 0 ? Args[0] : FPaths::ProjectDir() / TEXT("Evaluator/models/model_20250411_222609_1");
+		const FString NdjsonPath = Args.Num() > 1 ? Args[1] : FPaths::ProjectContentDir() / TEXT("PaintingHistory/Painting_0.ndjson");
+		const int32 PointsPerUpdate = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 2;
+
+		TSharedRef<FQuickDrawModel, ESPMode::ThreadSafe> Model = MakeShared<FQuickDrawModel, ESPMode::ThreadSafe>();
+		TArray<FString> Lines;
+		if (!Model->Load(ModelRoot) || !FFileHelper::LoadFileToStringArray(Lines, *NdjsonPath))
+			return;
+
+		int32 NumDrawings = 0, NumUpdates = 0, NumAgreeing = 0;
+		int64 StreamSteps = 0, FullSteps = 0;
+		double StreamSeconds = 0.0, FullSeconds = 0.0;
+		float MaxDifference = 0.0f;
+
+		TArray<float> AllPoints, Prefix, Ink, StreamLogits, FullLogits;
+		for (const FString& Line : Lines)
+		{
+			FPaintingHeader Header;
+			FPainting Painting;
+			if (!FPaintingBinaryFormat::ParseNdjsonLine(Line, Header, Painting))
+				continue;
+
+			AllPoints.Reset();
+			for (const FStroke& Stroke : Painting.Strokes)
+				FQuickDrawModel::AppendStrokePoints(Stroke, AllPoints);
+
+			const int32 NumPoints = AllPoints.Num() / InputChannels;
+			if (NumPoints < 2)
+				continue;
+
+			FQuickDrawStream Stream(Model);
+			int32 PrevCount = 0;
+			for (int32 Count = FMath::Min(2, NumPoints); ; Count = FMath::Min(Count + PointsPerUpdate, NumPoints))
+			{
+				// The newest point ends the stroke being drawn, the one that ended it in the previous update is replaced
+				Prefix = TArray<float>(AllPoints.GetData(), Count * InputChannels);
+				Prefix.Last() = 1.0f;
+
+				const int32 NumKept = FMath::Max(PrevCount - 1, 0);
+				double Start = FPlatformTime::Seconds();
+				const bool bUpdated = Stream.Update(NumKept, TConstArrayView<float>(Prefix).RightChop(NumKept * InputChannels), StreamLogits);
+				StreamSeconds += FPlatformTime::Seconds() - Start;
+				StreamSteps += bUpdated ? Stream.GetLastRecomputedSteps() : 0;
+				PrevCount = Count;
+
+				// What predicting the whole drawing every time would cost
+				Start = FPlatformTime::Seconds();
+				FQuickDrawStream Full(Model);
+				Full.Update(0, Prefix, FullLogits);
+				FullSeconds += FPlatformTime::Seconds() - Start;
+				FullSteps += Full.GetLastRecomputedSteps();
+
+				++NumUpdates;
+				if (Count == NumPoints)
+					break;
+			}
+
+			// The last live guess against the exact prediction made on Confirm
+			const int32 NumSteps = FQuickDrawModel::MakeInput(Painting, Ink);
+			Model->Forward(Ink, NumSteps, FullLogits);
+
+			int32 StreamBest = 0, FullBest = 0;
+			for (int32 c = 0; c < FullLogits.Num(); ++c)
+			{
+				MaxDifference = FMath::Max(MaxDifference, FMath::Abs(StreamLogits[c] - FullLogits[c]));
+				StreamBest = StreamLogits[c] > StreamLogits[StreamBest] ? c : StreamBest;
+				FullBest = FullLogits[c] > FullLogits[FullBest] ? c : FullBest;
+			}
+
+			NumAgreeing += StreamBest == FullBest ? 1 : 0;
+			++NumDrawings;
+		}
+
+		if (NumUpdates == 0)
+			return;
+
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawStream] %d drawings, %d updates of %d points"), NumDrawings, NumUpdates, PointsPerUpdate);
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawStream] Incremental: %.3f ms and %.1f LSTM steps per update"), StreamSeconds * 1000.0 / NumUpdates, (double)StreamSteps / NumUpdates);
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawStream] Full: %.3f ms and %.1f LSTM steps per update"), FullSeconds * 1000.0 / NumUpdates, (double)FullSteps / NumUpdates);
+		UE_LOG(LogTemp, Display, TEXT("[FQuickDrawStream] Final guess agrees with Confirm on %d / %d drawings, max logit difference %g"), NumAgreeing, NumDrawings, MaxDifference);
+	}
+
+	FAutoConsoleCommand BenchmarkLivePredictionCommand(
+		TEXT("SpeedArtist.Benchmark.LivePrediction"),
+		TEXT("Replays drawings point by point through the live predictor and compares it with full passes. Args: [ModelRootPath] [NdjsonPath] [PointsPerUpdate]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunLivePredictionBenchmark));
+}
+
+#endif
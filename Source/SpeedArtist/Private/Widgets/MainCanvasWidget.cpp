@@ -51,3 +51,11 @@ void UMainCanvasWidget::ResetPrediction()
 	}
 	PredictedClassTextBlock->SetText(FText::FromString("-"));
 }
+
+void UMainCanvasWidget::ShowLiveGuesses(const TArray<FString>& Guesses)
+{
+	if (!IsValid(PredictedClassTextBlock))
+		return;
+
+	PredictedClassTextBlock->SetText(FText::FromString(Guesses.Num() > 0 ? FString::Join(Guesses, TEXT(", ")) : TEXT("-")));
+}
@@ -7,24 +7,57 @@
 #include <memory>
 
 #include "CoreMinimal.h"
+#include "Drawing/CanvasInputSampler.h"
+#include "Drawing/CanvasTileStore.h"
+#include "Drawing/CanvasUploadRing.h"
 #include "GameFramework/Actor.h"
 #include "CanvasArea.generated.h"
 
-struct SPEEDARTIST_API FPoint
-{
-	FVector Coords;
-	bool Fixed = true;
-};
-
+// Stroke points as parallel arrays, canvas pixel coordinates fit in 16 bits
 struct SPEEDARTIST_API FStroke
 {
-	TArray<FPoint> Points;
+	TArray<int16> Xs;
+	TArray<int16> Ys;
+
+	// Milliseconds since the previous point, 0 for the first one
+	TArray<uint32> TimeDeltas;
+
+	// Points kept by the last simplification, all set for a stroke that was never simplified
+	TBitArray<> KeepFlags;
+
+	// Tolerance of the last simplification, negative until the finished stroke gets simplified
+	float SimplifiedEps = -1.0f;
+
+	// While the stroke is drawn, SimplifyTail fixes the keep flags of the points before NumSettledPoints until the stroke
+	// is finished, at TailEps. The last settled point is kept and anchors the tail, which is simplified again on every call.
+	int32 NumSettledPoints = 0;
+	float TailEps = -1.0f;
+
+	// The tail is settled once it is this many points longer than its last SimplifyTailPoints points
+	static constexpr int32 SimplifyTailPoints = 64;
+
+	void AddPoint(const int32 X, const int32 Y, const uint32 TimeDelta = 0);
 
-	void AddPoint(const FPoint& Point);
+	int32 Num() const { return Xs.Num(); }
+	FIntPoint GetPoint(const int32 Index) const { return FIntPoint(Xs[Index], Ys[Index]); }
+	bool IsKept(const int32 Index) const { return KeepFlags[Index]; }
+	bool IsSimplified(const float Eps) const { return SimplifiedEps == Eps; }
+
+	TConstArrayView<int16> GetXs() const { return Xs; }
+	TConstArrayView<int16> GetYs() const { return Ys; }
+	TConstArrayView<uint32> GetTimeDeltas() const { return TimeDeltas; }
 
 	FString Serialize();
 	void Simplify(float Eps);
-	void SimplifyRec(float Eps, int Left, int Right);
+
+	// Provisional simplification of a stroke being drawn, for live predictions: only the points after the settled ones
+	// are simplified, so each call costs time in proportion to the tail instead of the stroke. The settled points and
+	// the tail are simplified apart, which can keep a few more points than Simplify, so a finished stroke still goes
+	// through Simplify. Does not mark the stroke as simplified.
+	void SimplifyTail(float Eps);
+
+	// The tail SimplifyTail would simplify: the anchor, if any, and every point after it
+	int32 GetTailStart() const { return FMath::Max(NumSettledPoints - 1, 0); }
 };
 
 struct SPEEDARTIST_API FPainting
@@ -34,7 +67,54 @@ struct SPEEDARTIST_API FPainting
 	void AddStroke(const FStroke& Stroke);
 
 	FString Serialize();
-	void Simplify(float Eps);
+
+	// Simplifies the strokes on worker threads, in batches of similar point counts, unless the painting is small
+	void Simplify(float Eps, const bool bSingleThreaded = false);
+
+	// Below this many points to simplify, the task overhead outweighs the work
+	static constexpr int32 ParallelSimplifyMinPoints = 4096;
+	static constexpr int32 PointsPerSimplifyBatch = 2048;
+};
+
+UENUM(BlueprintType)
+enum class EStrokeRasterMode : uint8
+{
+	// A brush stamp every half radius along the stroke
+	Stamps,
+	// One capsule (two round caps and the quad between them) per stroke segment
+	Capsules
+};
+
+UENUM(BlueprintType)
+enum class ECanvasPixelFormat : uint8
+{
+	// Full color BGRA8 pixels
+	Color,
+	// One byte of ink coverage per pixel (0 paper, 255 ink), colorized by the canvas material
+	Coverage8
+};
+
+// Horizontal run of brush pixels, relative to the brush center: [Start, End)
+struct SPEEDARTIST_API FBrushSpan
+{
+	int32 Start = 0;
+	int32 End = 0;
+};
+
+// Pixels of one canvas tile, as they were before a stroke modified it
+struct SPEEDARTIST_API FCanvasTileSnapshot
+{
+	int32 TileIndex = 0;
+
+	// Empty for a blank tile of the tiled storage
+	TArray<uint8> Pixels;
+};
+
+// Everything needed to undo or redo one stroke. The snapshots are swapped with the canvas contents on every undo/redo.
+struct SPEEDARTIST_API FCanvasUndoStep
+{
+	TArray<FCanvasTileSnapshot> Tiles;
+	FStroke Stroke;
 };
 
 UCLASS()
@@ -50,6 +130,9 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Called when the actor is removed from play
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:
 	
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
@@ -63,6 +146,40 @@ public:
 	
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
 	int32 StartBrushRadius = 10;
+
+	// When set, drawing only writes to the pixel buffer and the texture is uploaded once per frame
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	bool bDeferCanvasUpload = true;
+
+	// Read by InitializeCanvas
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	ECanvasPixelFormat CanvasPixelFormat = ECanvasPixelFormat::Color;
+
+	// Keep the pixels in sparse tiles so memory scales with the painted area (read by InitializeCanvas)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	bool bUseTiledStorage = false;
+
+	// Staging buffers in flight between the game and render threads, 2 for double buffering, 3 for triple (read by InitializeCanvas)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	int32 NumUploadSlots = 3;
+
+	// Draw through every cursor move since the last frame instead of the last position only (read by BeginPlay)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	bool bSampleEveryCursorMove = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	EStrokeRasterMode StrokeRasterMode = EStrokeRasterMode::Capsules;
+
+	// Smooth the capsule edges using the distance to the segment (capsule mode only)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	bool bAntiAliasedStrokes = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	int32 MaxUndoSteps = 32;
+
+	// Strokes are simplified with this tolerance while they are drawn and when they are finished, so the painting is ready to submit
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Variables)
+	float StrokeSimplifyEps = 2.0f;
 	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
@@ -77,6 +194,9 @@ public:
 	UFUNCTION(BlueprintCallable, Category = DrawingTools)
 	void UpdateCanvas();
 	
+	UFUNCTION(BlueprintCallable, Category = DrawingTools)
+	void FlushCanvas();
+	
 	UFUNCTION(BlueprintCallable, Category = DrawingTools)
 	void ClearCanvas();
 
@@ -86,38 +206,115 @@ public:
 	UFUNCTION(BlueprintCallable, Category = DrawingTools)
 	void DrawDot(const int32 PixelCoordX, const int32 PixelCoordY);
 	
+	UFUNCTION(BlueprintCallable, Category = DrawingTools)
+	void DrawSegment(const int32 StartX, const int32 StartY, const int32 EndX, const int32 EndY);
+	
 	UFUNCTION(BlueprintCallable, Category = DrawingTools)
 	void SaveTexture();
+	
+	UFUNCTION(BlueprintCallable, Category = DrawingTools)
+	bool UndoStroke();
+	
+	UFUNCTION(BlueprintCallable, Category = DrawingTools)
+	bool RedoStroke();
+
+	// Replaces the canvas with a painting, redrawn in parallel horizontal bands. The painting becomes the current one and
+	// the undo history is cleared. Refused while a stroke is being drawn, which would lose it; returns false then.
+	bool RasterizePainting(const FPainting& Painting, const bool bSingleThreaded = false);
 
 	FPainting& GetCurrentPainting();
 
+	// The stroke being drawn, which only joins the painting once it is finished, or null between strokes
+	const FStroke* GetStrokeInProgress() const { return bStrokeInProgress ? &CurrentStroke : nullptr; }
+
+	// Changes whenever the strokes of the painting change other than by a finished stroke joining them
+	uint32 GetPaintingRevision() const { return PaintingRevision; }
+	FIntPoint GetCanvasSize() const { return FIntPoint(CanvasWidth, CanvasHeight); }
+
+	// Copies the canvas into a dense buffer, rows of CanvasWidth pixels, whichever storage it uses
+	void CopyPixels(TArray<uint8>& OutPixels) const;
+
 private:
 
 	// References
 	UWorld* World = nullptr;
 	APlayerController* PlayerController = nullptr;
 
-	// Canvas
+	// Canvas, either dense or tiled
 	std::unique_ptr<uint8[]> CanvasPixelData;
+	FCanvasTileStore TileStore;
+	bool bCanvasIsTiled = false;
+	bool bCanvasIsCoverage = false;
 	int CanvasWidth;
 	int CanvasHeight;
 	int BytesPerPixel;
 	int BufferPitch;
 	int BufferSize;
-	std::unique_ptr<FUpdateTextureRegion2D> EchoUpdateTextureRegion;
 
-	// Draw brush tool
-	std::unique_ptr<uint8[]> CanvasBrushMask;
+	// Regions of the canvas modified since the last upload
+	TSharedPtr<FCanvasUploadRing, ESPMode::ThreadSafe> UploadRing;
+	TArray<FIntRect> DirtyRects;
+	static constexpr int32 MaxDirtyRects = 8;
+
+	// Fixed cost of uploading one more region, expressed in pixels
+	static constexpr int64 DirtyRectOverheadPixels = 64 * 64;
+
+	// Draw brush tool, one span per row from -Radius to Radius - 1
+	TArray<FBrushSpan> BrushSpans;
+	FColor BrushColor = FColor::Black;
+	FColor PaperColor = FColor(255, 255, 255, 0);
+	uint8 InkCoverage = 255;
+	uint8 PaperCoverage = 0;
 	int Radius;
-	int BrushBufferSize;
 
 	// Model data storage
 	FPainting CurrentPainting;
 	FStroke CurrentStroke;
+	bool bStrokeInProgress = false;
+	uint32 PaintingRevision = 0;
 
 	UE::Math::TVector2<float> PrevCoords = UE::Math::TVector2(-1.0f, -1.0f);
+	double PrevPointTime = 0.0;
+
+	// Cursor moves between frames, drained by Draw
+	TSharedPtr<FCanvasInputSampler> InputSampler;
+	TArray<FCanvasInputSample> PendingInputSamples;
+
+	// Stroke history, made of snapshots of the tiles each stroke touched
+	TArray<FCanvasUndoStep> UndoSteps;
+	TArray<FCanvasUndoStep> RedoSteps;
+	FCanvasUndoStep CurrentUndoStep;
+	TBitArray<> CapturedUndoTiles;
+	int32 UndoTileCountX = 0;
+	bool bRecordingUndoStep = false;
+	
+	void ClearPixels();
+	const uint8* GetPaperPixel() const;
 	
-	void SetPixelColor(uint8*& Pointer, uint8 Red, uint8 Green, uint8 Blue, uint8 Alpha);
+	void ClearUndoHistory();
+	void CaptureTilesForUndo(const int32 Y, const int32 StartX, const int32 EndX);
+	void SwapUndoTiles(FCanvasUndoStep& Step);
+	FIntRect GetTileRect(const int32 TileIndex) const;
 
+	// Traces the canvas under a viewport position and extends the current stroke to it, or starts a new stroke when the
+	// cursor comes back from outside the canvas
+	void DrawAtViewportPosition(const FVector2D& ViewportPosition, const double Time);
+
+	// A stroke is drawn without gaps, one press of the button can make several of them
+	void BeginStroke();
+	void EndStroke();
+
+	// A stroke step draws the stroke from Start to End, the first step of a stroke has Start == End
+	void DrawStrokeStep(const FIntPoint Start, const FIntPoint End);
+	void RasterizeStrokeStep(const FIntPoint Start, const FIntPoint End, const FIntRect& Clip);
+	FIntRect GetStrokeStepBounds(const FIntPoint Start, const FIntPoint End) const;
+
+	void RasterizeDot(const int32 PixelCoordX, const int32 PixelCoordY, const FIntRect& Clip);
+	void RasterizeSegment(const int32 StartX, const int32 StartY, const int32 EndX, const int32 EndY, const FIntRect& Clip);
+	
+	void FillRowSpan(const int32 Y, const int32 StartX, const int32 EndX);
+	void BlendRowSpan(const int32 Y, const int32 StartX, const int32 EndX, const FColor Color);
 
+	void MarkDirty(const FIntRect& Rect);
+	static int64 GetMergeCost(const FIntRect& A, const FIntRect& B);
 };
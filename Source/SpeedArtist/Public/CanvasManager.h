@@ -4,6 +4,12 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "Drawing/PaintingHistoryLog.h"
+#include "Drawing/PaintingNdjsonWriter.h"
+#include "Evaluation/EvaluatorProcess.h"
+#include "Evaluation/QuickDrawBatchQueue.h"
+#include "Evaluation/QuickDrawModel.h"
+#include "Evaluation/QuickDrawStream.h"
 #include "CanvasManager.generated.h"
 
 
@@ -21,18 +27,26 @@ enum EDrawingState
 	RoundEnded
 };
 
-class SPEEDARTIST_API FRunOutputThroughModel : public FRunnable
+UENUM()
+enum class EEvaluatorBackend : uint8
 {
-public:
-	FRunOutputThroughModel(FString FullFilePath, UCanvasManager* CanvasManagerRef);
-	
-	virtual bool Init() override;
-	virtual uint32 Run() override;
-	virtual void Stop() override;
+	// PaintingRater.py in a worker process
+	PythonWorker,
+
+	// FQuickDrawModel in the game process, needs the weights from Evaluator/ExportModel.py. Run SpeedArtist.Model.Parity
+	// on the exported checkpoint before switching to it.
+	Native
+};
 
-	FRunnableThread* Thread = nullptr;
-	FString FilePath;
-	UCanvasManager* CanvasManager;
+// Storage of the native model's LSTM weights, in the same order as EQuickDrawPrecision. Float16 and Int8 only save
+// memory (about 2 and 1 MB of weights instead of 4) and they are slower: the weights are widened back to fp32 as they
+// are read, and the fp32 weights are shared by every canvas and already fit in cache. Float32 is the fastest.
+UENUM()
+enum class ENativeModelPrecision : uint8
+{
+	Float32,
+	Float16,
+	Int8
 };
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
@@ -47,6 +61,9 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+
+	// Called when the game ends
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	
 	void BeginRound();
 	void EndRound();
@@ -57,6 +74,58 @@ public:
 	
 	void StartGame();
 
+	// Falls back to the Python worker when the native model cannot be loaded
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	EEvaluatorBackend EvaluatorBackend = EEvaluatorBackend::PythonWorker;
+
+	// Relative to the project directory, <Path>.weights and <Path>_classes are loaded
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	FString NativeModelPath = TEXT("Evaluator/models/model_20250411_222609_1");
+
+	// The smaller variants need ExportModel.py --precision fp16 / int8, they trade speed for memory
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	ENativeModelPrecision NativeModelPrecision = ENativeModelPrecision::Float32;
+
+	// Every canvas using the same native model shares one batch queue, built with the settings of the first one to start.
+	// Paintings confirmed this close together are evaluated in one pass.
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	float NativeBatchWindowMs = 5.0f;
+
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	int32 NativeMaxBatchSize = 8;
+
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	FString EvaluatorExecutable = TEXT("C:\\Users\\mihne\\anaconda3\\envs\\SpeedArtist-PyTorch\\python.exe");
+
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	FString EvaluatorArguments = TEXT("PaintingRater.py --server");
+
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	FString EvaluatorWorkingDirectory = TEXT("G:\\Python\\SpeedArtist-PyTorch");
+
+	// Show the best guesses while the player draws, only with the native model
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	bool bLivePrediction = true;
+
+	// Seconds between two live guesses
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	float LivePredictionInterval = 0.25f;
+
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	int32 LiveGuessCount = 3;
+
+	// Steps at the end of the drawing the backward LSTM is rerun over for a live guess, more is closer to the final answer
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	int32 LiveBackwardWindow = 32;
+
+	// Run StubEvaluator.py instead, which answers with the class to draw and needs neither torch nor the model
+	UPROPERTY(EditAnywhere, Category="Evaluator")
+	bool bUseStubEvaluator = false;
+
+	// Size after which the painting history starts a new file
+	UPROPERTY(EditAnywhere, Category="History")
+	int32 MaxHistorySegmentMB = 64;
+
 	UPROPERTY(EditAnywhere, Category="Widget References")
 	TSubclassOf<UUserWidget> MainWidgetBP;
 	UMainCanvasWidget* MainCanvasWidget;
@@ -64,10 +133,15 @@ public:
 private:
 	UFUNCTION(BlueprintCallable)
 	void HandleOnConfirm(APlayerCharacter* Player);
-	void CheckEvaluationDone();
 
 	UFUNCTION(BlueprintCallable)
 	void HandleOnReset(APlayerCharacter* Player);
+
+	UFUNCTION(BlueprintCallable)
+	void HandleOnUndo(APlayerCharacter* Player);
+
+	UFUNCTION(BlueprintCallable)
+	void HandleOnRedo(APlayerCharacter* Player);
 	
 	UFUNCTION(BlueprintCallable)
 	void HandleOnStartDrawing(APlayerCharacter* Player);
@@ -78,7 +152,13 @@ private:
 	UFUNCTION(BlueprintCallable)
 	void HandleOnStopDrawing(APlayerCharacter* Player);
 
-	FString CreateModelInputJson(FPainting Painting, FString ClassName);
+	void WriteModelInput(const FPainting& Painting, const FString& ClassName);
+
+	// Reused for every painting sent to the model
+	FPaintingNdjsonWriter NdjsonWriter;
+
+	// Every confirmed painting, kept across sessions. Shared with the other canvases writing to the same directory.
+	TSharedPtr<FPaintingHistoryLog, ESPMode::ThreadSafe> HistoryLog;
 
 	UPROPERTY(EditInstanceOnly)
 	ACanvasArea* CanvasArea;
@@ -86,19 +166,37 @@ private:
 	void StartGameDelayed();
 	void ChooseRandomClass();
 
-	void ProcessEvaluationResult();
+	void ProcessEvaluationResult(const FEvaluationResult& Result);
 
 	TArray<FString> Classes{ "airplane", "ant", "axe", "bed" };
 	FString CurrentClass;
+	FDateTime RoundStartTime;
 
 	EDrawingState CurrentDrawingState = WaitingForStart;
 
-	bool ReceivedNewEvaluationResult = false;
-	int ResponseCode = 0;
-	FString StandardOutput;
-	FString StandardError;
+	// Long-lived model worker, restarted when it fails
+	TUniquePtr<FEvaluatorProcess> Evaluator;
+
+	// Shared with the other canvases, NativeModel is the model it runs
+	TSharedPtr<FQuickDrawBatchQueue, ESPMode::ThreadSafe> NativeQueue;
+	TSharedPtr<const FQuickDrawModel, ESPMode::ThreadSafe> NativeModel;
+
+	void EvaluateNative(const FPainting& Painting);
+
+	// Layer outputs of the current round's painting, updated on the thread pool one update at a time
+	TSharedPtr<FQuickDrawStream, ESPMode::ThreadSafe> LiveStream;
+	int32 LiveRound = 0;
+	bool bLiveUpdateInFlight = false;
+	double LastLiveUpdateTime = 0.0;
 
-	FTimerHandle CurrentTimerHandle;
+	// The points handed to the stream for good, as of a painting revision: every point of the first LiveFinishedStrokes
+	// strokes and the open stroke's points before LiveOpenPoints, LiveStablePoints kept points in all. The kept points of
+	// the open stroke start at LiveOpenStrokeStart.
+	uint32 LivePaintingRevision = 0;
+	int32 LiveFinishedStrokes = 0;
+	int32 LiveOpenPoints = 0;
+	int32 LiveOpenStrokeStart = 0;
+	int32 LiveStablePoints = 0;
 
-	friend class FRunOutputThroughModel;
+	void UpdateLivePrediction();
 };
@@ -26,6 +26,8 @@ protected:
 	virtual void StopDrawingInput(const FInputActionValue& Value) override;
 	virtual void ConfirmInput(const FInputActionValue& Value) override;
 	virtual void ResetInput(const FInputActionValue& Value) override;
+	virtual void UndoInput(const FInputActionValue& Value) override;
+	virtual void RedoInput(const FInputActionValue& Value) override;
 
 public:
 	void ToggleDrawingMode(bool bEnterDrawingMode);
@@ -50,6 +52,14 @@ public:
 	UPROPERTY(BlueprintAssignable)
 	FOnReset OnReset;
 
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnUndo, APlayerCharacter*, Player);
+	UPROPERTY(BlueprintAssignable)
+	FOnUndo OnUndo;
+
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnRedo, APlayerCharacter*, Player);
+	UPROPERTY(BlueprintAssignable)
+	FOnRedo OnRedo;
+
 private:
 	APlayerController* PlayerController = nullptr;
 	UCanvasDrawer* CanvasDrawerComp = nullptr;
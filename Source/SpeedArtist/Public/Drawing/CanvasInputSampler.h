@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Framework/Application/IInputProcessor.h"
+
+class UGameViewportClient;
+
+struct SPEEDARTIST_API FCanvasInputSample
+{
+	// Position in viewport pixels, as expected by APlayerController::DeprojectScreenPositionToWorld
+	FVector2D ViewportPosition;
+	double Time;
+};
+
+// Records every cursor move Slate receives, not just the last one of each frame.
+// The OS queues all the raw moves between two frames and Slate dispatches them one by one,
+// while the input actions only see where the cursor ended up.
+class SPEEDARTIST_API FCanvasInputSampler : public IInputProcessor
+{
+public:
+	explicit FCanvasInputSampler(UGameViewportClient* InViewportClient);
+
+	// Only moves made while capturing are recorded, starting a capture drops the previous samples
+	void SetCapturing(const bool bInCapturing);
+
+	// Moves the samples recorded since the last call into OutSamples, oldest first
+	int32 ConsumeSamples(TArray<FCanvasInputSample>& OutSamples);
+
+	// IInputProcessor
+	virtual void Tick(const float DeltaTime, FSlateApplication& SlateApp, TSharedRef<ICursor> Cursor) override {}
+	virtual bool HandleMouseMoveEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent) override;
+	virtual const TCHAR* GetDebugName() const override { return TEXT("CanvasInputSampler"); }
+
+private:
+	TWeakObjectPtr<UGameViewportClient> ViewportClient;
+	TArray<FCanvasInputSample> Samples;
+	bool bCapturing = false;
+
+	// Bounds the buffer if the game thread stalls for a long time while drawing
+	static constexpr int32 MaxSamples = 4096;
+};
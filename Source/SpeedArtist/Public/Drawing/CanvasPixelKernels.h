@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Row kernels working on BGRA8 pixels (FColor memory layout) and 8-bit coverage pixels.
+// The best implementation for the running CPU (AVX2, SSE2 or scalar) is picked on first use,
+// and every implementation produces the exact same bytes.
+struct SPEEDARTIST_API FCanvasPixelKernels
+{
+	// Writes Color to Count consecutive pixels
+	static void FillSpan(FColor* Dst, const int32 Count, const FColor Color);
+
+	// Writes Color to a Width x Height block, rows being PitchPixels apart
+	static void FillRect(FColor* Dst, const int32 Width, const int32 Height, const int32 PitchPixels, const FColor Color);
+
+	// Blends Color over Count consecutive pixels, using Color.A as the opacity
+	static void BlendSpan(FColor* Dst, const int32 Count, const FColor Color);
+
+	// Writes Value to Count consecutive 8-bit pixels
+	static void FillCoverageSpan(uint8* Dst, const int32 Count, const uint8 Value);
+
+	// Blends Value over Count consecutive 8-bit pixels with the given opacity
+	static void BlendCoverageSpan(uint8* Dst, const int32 Count, const uint8 Value, const uint8 Alpha);
+
+	// Name of the implementation in use, for logging
+	static const TCHAR* GetImplementationName();
+};
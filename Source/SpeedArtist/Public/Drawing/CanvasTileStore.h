@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "CoreMinimal.h"
+
+// Sparse canvas pixel storage split in square tiles.
+// Tiles are only allocated once something is written to them, untouched ones read from a single shared blank tile.
+class SPEEDARTIST_API FCanvasTileStore
+{
+public:
+	static constexpr int32 TileSize = 64;
+
+	using FBlankTileRef = TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe>;
+
+	void Initialize(const int32 InWidth, const int32 InHeight, const int32 InBytesPerPixel, const uint8* PaperPixel);
+
+	// Drops every painted tile, O(tiles)
+	void Clear(const uint8* PaperPixel);
+
+	bool IsTileAllocated(const int32 TileX, const int32 TileY) const;
+
+	// Copies a painted tile into OutPixels, leaving it empty for a blank tile
+	void CopyTile(const int32 TileIndex, TArray<uint8>& OutPixels) const;
+
+	// Overwrites a tile with pixels from CopyTile, an empty array makes it blank again
+	void RestoreTile(const int32 TileIndex, const TArray<uint8>& Pixels);
+
+	// Pixel (X, Y), allocating its tile if needed. The row stays contiguous up to the end of the tile.
+	uint8* GetMutablePixel(const int32 X, const int32 Y);
+	const uint8* GetPixel(const int32 X, const int32 Y) const;
+
+	// Calls Func(Pixels, Count) for each contiguous run of [StartX, EndX) on row Y
+	template <typename FuncType>
+	void ForEachMutableRun(const int32 Y, int32 StartX, const int32 EndX, FuncType&& Func)
+	{
+		while (StartX < EndX)
+		{
+			const int32 RunEnd = FMath::Min(EndX, (StartX / TileSize + 1) * TileSize);
+			Func(GetMutablePixel(StartX, Y), RunEnd - StartX);
+			StartX = RunEnd;
+		}
+	}
+
+	// The shared blank tile, kept alive by the returned reference (e.g. while the render thread reads it)
+	FBlankTileRef GetBlankTile() const { return BlankTile; }
+
+	int32 GetTilePitch() const { return TileSize * BytesPerPixel; }
+	int32 GetTileCountX() const { return TileCountX; }
+	int32 GetTileCountY() const { return TileCountY; }
+	int64 GetAllocatedBytes() const;
+
+private:
+	int32 Width = 0;
+	int32 Height = 0;
+	int32 BytesPerPixel = 0;
+	int32 TileCountX = 0;
+	int32 TileCountY = 0;
+
+	// Null entries are blank tiles. Different tiles may be allocated from different threads.
+	TArray<std::unique_ptr<uint8[]>> Tiles;
+	std::atomic<int32> AllocatedTileCount = 0;
+	
+	FBlankTileRef BlankTile;
+
+	void FillBlankTile(const uint8* PaperPixel);
+};
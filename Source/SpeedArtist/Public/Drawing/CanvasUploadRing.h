@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "CoreMinimal.h"
+
+// Ring of staging buffers used to hand canvas pixels over to the render thread.
+// The game thread acquires a free slot and fills it, the texture upload cleanup callback releases it
+// once the render thread is done. Acquiring never blocks: when every slot is in flight, the caller retries later.
+class SPEEDARTIST_API FCanvasUploadRing
+{
+public:
+	explicit FCanvasUploadRing(const int32 NumSlots);
+
+	// Index of a free slot holding at least NumBytes, or INDEX_NONE when all of them are in flight
+	int32 AcquireSlot(const int32 NumBytes);
+	uint8* GetSlotData(const int32 Slot);
+
+	// Safe to call from any thread
+	void ReleaseSlot(const int32 Slot);
+
+private:
+	struct FSlot
+	{
+		TArray<uint8> Data;
+		std::atomic<bool> bInFlight = false;
+	};
+
+	TArray<std::unique_ptr<FSlot>> Slots;
+	int32 NextSlot = 0;
+};
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+struct FPainting;
+
+// Everything stored about a painting besides its strokes
+struct SPEEDARTIST_API FPaintingHeader
+{
+	FString Word;
+	int32 CanvasWidth = 0;
+	int32 CanvasHeight = 0;
+
+	// UTC, zero when unknown (paintings converted from ndjson)
+	FDateTime StartTime = FDateTime(0);
+	FDateTime SubmitTime = FDateTime(0);
+};
+
+// Versioned binary paintings. A file is a sequence of self-contained records, all little endian:
+//
+//   uint32 Magic, uint16 Version, uint16 Reserved, uint32 PayloadSize
+//   Payload:
+//     varint CanvasWidth, varint CanvasHeight, int64 StartTime ticks, int64 SubmitTime ticks
+//     varint WordLength, UTF-8 Word
+//     varint StrokeCount, then per stroke:
+//       varint PointCount, float SimplifiedEps
+//       PointCount x (zigzag varint dX, zigzag varint dY, varint TimeDelta), deltas from the previous point of the stroke
+//       (PointCount + 7) / 8 bytes of keep flags, lowest bit first
+//
+// Readers skip whole records they do not understand by PayloadSize.
+struct SPEEDARTIST_API FPaintingBinaryFormat
+{
+	static constexpr uint32 Magic = 0x50415053; // "SPAP"
+	static constexpr uint16 Version = 1;
+	static constexpr int32 RecordHeaderSize = 12;
+
+	// Appends one record to Out
+	static void Write(const FPaintingHeader& Header, const FPainting& Painting, TArray<uint8>& Out);
+
+	// Reads the record starting at Offset and moves Offset past it, false on truncated or corrupted data
+	static bool Read(TArrayView64<const uint8> Bytes, int64& Offset, FPaintingHeader& OutHeader, FPainting& OutPainting);
+
+	// Lossless in both directions for what ndjson holds, the word and the kept points, empty strokes included
+	static bool ConvertNdjsonToBinary(const TCHAR* NdjsonPath, const TCHAR* BinaryPath);
+	static bool ConvertBinaryToNdjson(const TCHAR* BinaryPath, const TCHAR* NdjsonPath);
+
+	// Paintings from ndjson have no canvas size, timings or simplification tolerance, every point is kept
+	static bool ParseNdjsonLine(const FString& Line, FPaintingHeader& OutHeader, FPainting& OutPainting);
+};
+
+// Walks the records of a binary painting file, mapped in memory instead of loaded
+class SPEEDARTIST_API FPaintingBinaryReader
+{
+public:
+	FPaintingBinaryReader();
+	~FPaintingBinaryReader();
+
+	bool Open(const TCHAR* FilePath);
+	void Close();
+
+	bool ReadNext(FPaintingHeader& OutHeader, FPainting& OutPainting);
+
+	TArrayView64<const uint8> GetBytes() const { return Bytes; }
+
+private:
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	TArrayView64<const uint8> Bytes;
+	int64 Offset = 0;
+};
@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "Drawing/PaintingBinaryFormat.h"
+#include "HAL/Runnable.h"
+
+class FEvent;
+class FRunnableThread;
+class IFileHandle;
+
+// One fixed-size entry per record, so record N is found at N * sizeof(FPaintingHistoryIndexEntry) in the index
+struct FPaintingHistoryIndexEntry
+{
+	uint32 Segment = 0;
+	uint32 Length = 0;
+	int64 Offset = 0;
+	int64 SubmitTicks = 0;
+
+	// UTF-8, zero padded and truncated if needed
+	ANSICHAR Word[40] = {};
+};
+static_assert(sizeof(FPaintingHistoryIndexEntry) == 64, "The history index layout is part of the file format");
+
+// Append-only painting history. Records use FPaintingBinaryFormat and go to History_<Segment>.spaint files that
+// are rotated by size, History.index lists every record across segments. All the disk work happens on a
+// background thread, appending only serializes the painting and queues it.
+class SPEEDARTIST_API FPaintingHistoryLog : public FRunnable
+{
+public:
+	FPaintingHistoryLog(const FString& InDirectory, const int64 InMaxSegmentBytes);
+	virtual ~FPaintingHistoryLog() override;
+
+	// One log per directory, so every canvas appends to the same segments and index instead of overwriting each
+	// other's. The segment size of the first caller wins. Game thread only.
+	static TSharedPtr<FPaintingHistoryLog, ESPMode::ThreadSafe> GetShared(const FString& InDirectory, const int64 InMaxSegmentBytes);
+
+	// Any thread. Returns the index of the new record, readable once the flusher has written it
+	int64 Append(const FPaintingHeader& Header, const FPainting& Painting);
+
+	// Random access to any flushed record
+	bool ReadRecord(const int64 RecordIndex, FPaintingHeader& OutHeader, FPainting& OutPainting) const;
+	bool ReadIndexEntry(const int64 RecordIndex, FPaintingHistoryIndexEntry& OutEntry) const;
+
+	int64 GetNumRecords() const { return NumRecords; }
+	int64 GetNumFlushedRecords() const { return NumFlushedRecords; }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	struct FPendingRecord
+	{
+		TArray<uint8> Bytes;
+		int64 SubmitTicks;
+		FString Word;
+	};
+
+	FString Directory;
+	int64 MaxSegmentBytes;
+
+	// Producers take the lock so record indices follow the queue order
+	FCriticalSection AppendLock;
+	TQueue<FPendingRecord, EQueueMode::Spsc> PendingRecords;
+	std::atomic<int64> NumRecords = 0;
+	std::atomic<int64> NumFlushedRecords = 0;
+
+	// Only touched by the flusher thread after construction
+	TUniquePtr<IFileHandle> SegmentFile;
+	TUniquePtr<IFileHandle> IndexFile;
+	uint32 Segment = 0;
+	int64 SegmentSize = 0;
+
+	FEvent* WakeEvent = nullptr;
+	FRunnableThread* Thread = nullptr;
+	std::atomic<bool> bStopping = false;
+
+	FString GetSegmentPath(const uint32 InSegment) const;
+	FString GetIndexPath() const;
+
+	void RecoverFromDisk();
+	void FlushPending();
+	bool OpenSegment(const uint32 InSegment);
+};
@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FPainting;
+struct FStroke;
+
+// Writes paintings as QuickDraw ndjson lines, {"word":...,"drawing":[[[xs],[ys]],...]}, straight into a UTF-8 buffer.
+// The buffer keeps its capacity between paintings, so once warmed up writing a painting does not allocate.
+class SPEEDARTIST_API FPaintingNdjsonWriter
+{
+public:
+	void Reset();
+
+	// Appends one line, terminated the same way FFileHelper::SaveStringArrayToFile does
+	void WriteLine(const FPainting& Painting, const FString& Word);
+
+	// Only the "drawing" value, as FPainting::Serialize formats it
+	void WriteDrawing(const FPainting& Painting);
+
+	TConstArrayView<uint8> GetBytes() const { return Buffer; }
+	bool SaveToFile(const TCHAR* FilePath) const;
+
+private:
+	TArray<uint8> Buffer;
+
+	// Grows the buffer by at most NumBytes and returns where to write them, Commit gives back the unused part
+	uint8* Begin(const int32 NumBytes);
+	void Commit(const uint8* End);
+
+	static uint8* WriteStroke(uint8* Out, const FStroke& Stroke);
+	static uint8* WriteAxis(uint8* Out, const FStroke& Stroke, TConstArrayView<int16> Values);
+	static uint8* WriteInt(uint8* Out, const int32 Value);
+	static uint8* WriteLiteral(uint8* Out, const ANSICHAR* Literal, const int32 Length);
+};
@@ -0,0 +1,20 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Ramer-Douglas-Peucker on integer polylines, without recursion or allocations in the steady state.
+// https://en.wikipedia.org/wiki/Ramer%E2%80%93Douglas%E2%80%93Peucker_algorithm
+//
+// The farthest point of each segment is found with exact squared distances. The previous implementation
+// compared float distances, so only the few points whose distance is within float rounding of the maximum
+// are re-evaluated that way, which keeps the output identical to it.
+struct SPEEDARTIST_API FStrokeSimplifier
+{
+	// Sets the flags of the points to keep, OutKeepFlags is resized to the number of points
+	static void Simplify(TConstArrayView<int16> Xs, TConstArrayView<int16> Ys, const float Eps, TBitArray<>& OutKeepFlags);
+
+	// The previous recursive implementation, kept as a reference for the benchmark
+	static void SimplifyReference(TConstArrayView<int16> Xs, TConstArrayView<int16> Ys, const float Eps, TBitArray<>& OutKeepFlags);
+};
@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Walks the brush stamp centers of a stroke segment using integer arithmetic only.
+// The segment is split into as many steps of at least half a radius as fit in it, with a stamp at
+// the start of each step, followed by a final stamp on End:
+//
+//   StepCount = max k such that k * Radius / 2 <= |End - Start|
+//   Center(i) = Start + floor((End - Start) * i / StepCount), for i in [0, StepCount)
+class SPEEDARTIST_API FStrokeStepper
+{
+public:
+	FStrokeStepper(const FIntPoint Start, const FIntPoint End, const int32 Radius);
+
+	// Writes the next stamp center, returns false once the segment is done
+	FORCEINLINE bool Next(FIntPoint& OutCenter)
+	{
+		if (Index > StepCount)
+			return false;
+
+		if (Index == StepCount)
+		{
+			OutCenter = End;
+			++Index;
+			return true;
+		}
+
+		OutCenter = Current;
+		++Index;
+
+		// Bresenham-style advance, X += Dx / StepCount with the remainder carried over
+		Current.X += QuotientX;
+		ErrorX += RemainderX;
+		if (ErrorX >= StepCount)
+		{
+			ErrorX -= StepCount;
+			++Current.X;
+		}
+		
+		Current.Y += QuotientY;
+		ErrorY += RemainderY;
+		if (ErrorY >= StepCount)
+		{
+			ErrorY -= StepCount;
+			++Current.Y;
+		}
+		
+		return true;
+	}
+
+	int32 GetStampCount() const { return StepCount + 1; }
+
+	static int32 ComputeStepCount(const FIntPoint Delta, const int32 Radius);
+
+private:
+	FIntPoint End;
+	FIntPoint Current;
+	int32 StepCount = 0;
+	int32 Index = 0;
+
+	int32 QuotientX = 0, RemainderX = 0, ErrorX = 0;
+	int32 QuotientY = 0, RemainderY = 0, ErrorY = 0;
+};
@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "HAL/Runnable.h"
+
+class FEvent;
+class FRunnableThread;
+
+struct SPEEDARTIST_API FEvaluatorSettings
+{
+	FString Executable;
+	FString Arguments;
+	FString WorkingDirectory;
+
+	// The first request after a start also waits for the model to load
+	float RequestTimeoutSeconds = 60.0f;
+	float RestartDelaySeconds = 1.0f;
+};
+
+struct SPEEDARTIST_API FEvaluationResult
+{
+	bool bSuccess = false;
+	FString ClassName;
+	TArray<float> Scores;
+	FString Error;
+};
+
+// Called on the game thread
+using FOnEvaluationComplete = TFunction<void(const FEvaluationResult&)>;
+
+// Keeps one evaluator worker (PaintingRater.py --server) alive for the whole session, so the model is only loaded once.
+// Requests and responses are framed the way Evaluator/EvaluatorProtocol.py describes and go over the worker's
+// stdin/stdout pipes, one at a time, from a background thread. A worker that exits or stops answering is restarted.
+class SPEEDARTIST_API FEvaluatorProcess : public FRunnable
+{
+public:
+	explicit FEvaluatorProcess(const FEvaluatorSettings& InSettings);
+	virtual ~FEvaluatorProcess() override;
+
+	// Queues one ndjson painting line
+	void Evaluate(TArray<uint8>&& NdjsonLine, FOnEvaluationComplete&& OnComplete);
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+	// "SAEV" as a little endian uint32, then the payload length
+	static constexpr uint32 FrameMagic = 0x56454153;
+	static constexpr int32 FrameHeaderSize = 8;
+
+private:
+	struct FRequest
+	{
+		TArray<uint8> Payload;
+		FOnEvaluationComplete OnComplete;
+	};
+
+	FEvaluatorSettings Settings;
+
+	TQueue<FRequest, EQueueMode::Mpsc> Requests;
+	FEvent* WakeEvent = nullptr;
+	FRunnableThread* Thread = nullptr;
+	std::atomic<bool> bStopping = false;
+
+	// Only touched by the worker thread
+	FProcHandle ProcessHandle;
+	void* StdInRead = nullptr;
+	void* StdInWrite = nullptr;
+	void* StdOutRead = nullptr;
+	void* StdOutWrite = nullptr;
+	TArray<uint8> ReceiveBuffer;
+
+	bool IsProcessRunning();
+	bool StartProcess();
+	void StopProcess();
+
+	bool SendFrame(const TArray<uint8>& Payload);
+	bool ReceiveFrame(TArray<uint8>& OutPayload, const double TimeoutSeconds);
+	bool ExtractFrame(TArray<uint8>& OutPayload);
+	void DrainOutput();
+
+	FEvaluationResult RoundTrip(const TArray<uint8>& Payload);
+	static FEvaluationResult ParseResponse(const TArray<uint8>& Payload);
+	static void Complete(FRequest& Request, FEvaluationResult&& Result);
+};
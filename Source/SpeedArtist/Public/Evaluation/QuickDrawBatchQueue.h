@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "Evaluation/EvaluatorProcess.h"
+#include "Evaluation/QuickDrawModel.h"
+#include "HAL/Runnable.h"
+
+class FEvent;
+class FRunnableThread;
+struct FPainting;
+
+struct SPEEDARTIST_API FQuickDrawBatchSettings
+{
+	// How long the oldest waiting painting holds its batch open for others to join
+	float BatchWindowSeconds = 0.005f;
+	int32 MaxBatchSize = 8;
+
+	// Paintings share a batch while the longest has at most this many times the steps of the shortest
+	float MaxLengthRatio = 1.5f;
+
+	// Off for callers that wait on the results themselves, the callbacks then run on the thread pool
+	bool bCompleteOnGameThread = true;
+};
+
+// Evaluates the paintings of any number of canvases with one shared native model. Paintings that arrive within
+// BatchWindowSeconds of each other are sorted by length and cut into batches of similar lengths, each batch is one
+// FQuickDrawModel::ForwardBatch and the batches run in parallel. A painting arriving on its own only waits for the window.
+class SPEEDARTIST_API FQuickDrawBatchQueue : public FRunnable
+{
+public:
+	FQuickDrawBatchQueue(const TSharedRef<const FQuickDrawModel, ESPMode::ThreadSafe>& InModel, const FQuickDrawBatchSettings& InSettings);
+	virtual ~FQuickDrawBatchQueue() override;
+
+	// Loads the model the first time and hands the same queue to everyone asking for it afterwards, with the settings
+	// of the first caller. Null when the model cannot be loaded. Game thread only.
+	static TSharedPtr<FQuickDrawBatchQueue, ESPMode::ThreadSafe> GetShared(const FString& ModelRootPath, const EQuickDrawPrecision Precision,
+		const FQuickDrawBatchSettings& Settings);
+
+	// Any thread. The painting is turned into model input right away, so it can change as soon as this returns.
+	void Evaluate(const FPainting& Painting, FOnEvaluationComplete&& OnComplete);
+
+	TSharedRef<const FQuickDrawModel, ESPMode::ThreadSafe> GetModel() const { return Model; }
+
+	int32 GetNumBatches() const { return NumBatches; }
+	int32 GetNumEvaluated() const { return NumEvaluated; }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	struct FRequest
+	{
+		TArray<float> Ink;
+		FOnEvaluationComplete OnComplete;
+		double QueueTime = 0.0;
+	};
+
+	TSharedRef<const FQuickDrawModel, ESPMode::ThreadSafe> Model;
+	FQuickDrawBatchSettings Settings;
+
+	TQueue<FRequest, EQueueMode::Mpsc> Requests;
+	FEvent* WakeEvent = nullptr;
+	FRunnableThread* Thread = nullptr;
+	std::atomic<bool> bStopping = false;
+
+	std::atomic<int32> NumBatches = 0;
+	std::atomic<int32> NumEvaluated = 0;
+
+	void RunBatches(TArray<FRequest>& Pending);
+	void Complete(FRequest& Request, FEvaluationResult&& Result) const;
+};
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/Float16.h"
+
+// How the LSTM matrices are stored. Everything else, and all the accumulation, stays fp32.
+enum class EQuickDrawPrecision : uint8
+{
+	Float32,
+	Float16,
+
+	// Symmetric, with one scale per gate row
+	Int8
+};
+
+// One packed LSTM matrix, only the array matching Precision is filled
+struct SPEEDARTIST_API FQuickDrawGateWeights
+{
+	EQuickDrawPrecision Precision = EQuickDrawPrecision::Float32;
+
+	TArray<float> Float32;
+	TArray<FFloat16> Float16;
+	TArray<int8> Int8;
+
+	// Int8 only, packed like the bias
+	TArray<float> Scales;
+
+	int64 GetAllocatedBytes() const;
+};
+
+// Kernels for FQuickDrawModel. The weights are repacked once, at load time, so that every kernel streams them
+// as 4-wide vectors holding the same input weight for 4 consecutive outputs. Those are accumulated against broadcast
+// inputs, with no horizontal sums. Output channel and hidden sizes have to be multiples of Lanes.
+// fp16 and int8 LSTM weights are widened to fp32 as they are loaded, int8 row scales are applied once per output.
+// The Reference versions take the same packed weights but use plain loops and the exact std activations.
+struct SPEEDARTIST_API FQuickDrawKernels
+{
+	static constexpr int32 Lanes = 4;
+	static constexpr int32 NumGates = 4;
+
+	// [Out][In][Kernel] -> [Out / Lanes][Kernel][In][Lanes]
+	static void PackConv(TConstArrayView<float> Weights, const int32 OutChannels, const int32 InChannels, const int32 KernelSize, TArray<float>& OutPacked);
+
+	// PaddedInput holds NumSteps + KernelSize - 1 rows, the first KernelSize / 2 and the last ones being zeros.
+	// Output rows are OutputStride floats apart.
+	static void Conv1d(const float* Packed, const float* Bias, const int32 OutChannels, const int32 InChannels, const int32 KernelSize,
+		const float* PaddedInput, const int32 NumSteps, float* Output, const int32 OutputStride);
+	static void Conv1dReference(const float* Packed, const float* Bias, const int32 OutChannels, const int32 InChannels, const int32 KernelSize,
+		const float* PaddedInput, const int32 NumSteps, float* Output, const int32 OutputStride);
+
+	// [4 * Hidden][Cols] in PyTorch gate order (input, forget, cell, output) -> [Hidden / Lanes][Cols][Gate][Lanes],
+	// so the four gates of Lanes hidden units come out of a single pass over the weights
+	static void PackGates(TConstArrayView<float> Weights, const int32 HiddenSize, const int32 Cols, FQuickDrawGateWeights& OutPacked);
+	static void PackGates(TConstArrayView<FFloat16> Weights, const int32 HiddenSize, const int32 Cols, FQuickDrawGateWeights& OutPacked);
+	static void PackGates(TConstArrayView<int8> Weights, TConstArrayView<float> RowScales, const int32 HiddenSize, const int32 Cols, FQuickDrawGateWeights& OutPacked);
+
+	// [4 * Hidden] -> [Hidden / Lanes][Gate][Lanes], the layout of the gate values
+	static void PackGateBias(TConstArrayView<float> Bias, const int32 HiddenSize, TArray<float>& OutPacked);
+
+	// Bias + W_ih x for every step, 4 * HiddenSize packed gate values per step
+	static void InputGates(const FQuickDrawGateWeights& Packed, const float* PackedBias, const int32 HiddenSize, const int32 InputSize,
+		const float* Input, const int32 NumSteps, float* OutGates);
+	static void InputGatesReference(const FQuickDrawGateWeights& Packed, const float* PackedBias, const int32 HiddenSize, const int32 InputSize,
+		const float* Input, const int32 NumSteps, float* OutGates);
+
+	// Adds W_hh h to the input gates of one step, applies the activations, updates Cell in place and writes the new
+	// hidden state. NewHidden must not overlap PrevHidden.
+	static void LstmStep(const FQuickDrawGateWeights& Packed, const int32 HiddenSize, const float* StepGates, const float* PrevHidden, float* Cell, float* NewHidden);
+	// LstmStep for BatchSize independent sequences, each with its own gates, hidden state and cell.
+	// Sequences go through every block of weights two at a time, sharing the weight loads.
+	static void LstmStepBatch(const FQuickDrawGateWeights& Packed, const int32 HiddenSize, const int32 BatchSize,
+		const float* const* StepGates, const float* const* PrevHidden, float* const* Cells, float* const* NewHidden);
+	static void LstmStepReference(const FQuickDrawGateWeights& Packed, const int32 HiddenSize, const float* StepGates, const float* PrevHidden, float* Cell, float* NewHidden);
+};
@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Evaluation/EvaluatorProcess.h"
+#include "Evaluation/QuickDrawKernels.h"
+
+struct FPainting;
+struct FStroke;
+
+// CPU inference for QuickDrawRNN (Evaluator/PaintingRater.py), with the weights exported by Evaluator/ExportModel.py:
+// 3 Conv1d layers, a 3-layer bidirectional LSTM, a sum over time and a Linear head.
+// Activations are time-major, [Step][Channel], which is also the batch_first layout of the PyTorch model.
+class SPEEDARTIST_API FQuickDrawModel
+{
+public:
+	static constexpr int32 InputChannels = 3;
+	static constexpr int32 NumConvLayers = 3;
+	static constexpr int32 NumLstmLayers = 3;
+
+	// "SAQW" as a little endian uint32. Version 1 files have no per tensor data type and are all fp32.
+	static constexpr uint32 WeightsMagic = 0x57514153;
+	static constexpr uint32 WeightsVersion = 2;
+
+	// Seconds spent in each layer by one forward pass
+	struct FTimings
+	{
+		double ConvSeconds[NumConvLayers] = {};
+		double LstmSeconds[NumLstmLayers] = {};
+		double HeadSeconds = 0.0;
+	};
+
+	// Reads <ModelRootPath>.weights (or the .fp16 / .int8 variant) and the class list, <ModelRootPath>_classes
+	bool Load(const FString& ModelRootPath, const EQuickDrawPrecision Precision = EQuickDrawPrecision::Float32);
+
+	// ".weights", ".fp16.weights" or ".int8.weights", as written by ExportModel.py
+	static const TCHAR* GetWeightsSuffix(const EQuickDrawPrecision Precision);
+
+	bool IsLoaded() const { return bLoaded; }
+	const TArray<FString>& GetClasses() const { return Classes; }
+	EQuickDrawPrecision GetPrecision() const { return Precision; }
+
+	// Memory held by every weight and bias
+	int64 GetWeightBytes() const;
+
+	// The kept points of a stroke as [X, Y, StrokeEnd] rows, the last one ending the stroke. A range that stops before
+	// the end of the stroke leaves the end flag off.
+	static void AppendStrokePoints(const FStroke& Stroke, TArray<float>& OutPoints, const int32 FirstPoint = 0, const int32 EndPoint = MAX_int32);
+
+	// Same preprocessing as parseLine: the kept points of all the strokes with a stroke end flag, normalized to
+	// their bounding box and turned into deltas. Returns the number of steps, one less than the number of points.
+	static int32 MakeInput(const FPainting& Painting, TArray<float>& OutInk);
+
+	// Ink holds NumSteps x InputChannels values. The reference kernels skip the vectorization and the fast activations.
+	bool Forward(TConstArrayView<float> Ink, const int32 NumSteps, TArray<float>& OutLogits,
+		const bool bReferenceKernels = false, FTimings* OutTimings = nullptr) const;
+
+	// Several drawings in one pass, each ink holding a multiple of InputChannels values. The LSTM steps of every drawing
+	// share their weight loads, and every drawing gets the logits Forward would give it. OutLogits follows the order of Inks.
+	bool ForwardBatch(TConstArrayView<TArray<float>> Inks, TArray<TArray<float>>& OutLogits) const;
+
+	// Thread safe, the model is only read
+	FEvaluationResult Evaluate(const FPainting& Painting) const;
+
+	// The best scoring class, along with all the scores
+	FEvaluationResult MakeResult(TArray<float>&& Logits) const;
+
+private:
+	// Reuses the layers step by step
+	friend class FQuickDrawStream;
+
+	struct FConv1d
+	{
+		int32 InChannels = 0;
+		int32 OutChannels = 0;
+		int32 KernelSize = 0;
+
+		// Packed by FQuickDrawKernels::PackConv
+		TArray<float> Weights;
+		TArray<float> Bias;
+	};
+
+	// Packed by FQuickDrawKernels::PackGates
+	struct FLstmDirection
+	{
+		FQuickDrawGateWeights InputWeights;
+		FQuickDrawGateWeights HiddenWeights;
+
+		// bias_ih + bias_hh
+		TArray<float> Bias;
+	};
+
+	struct FLstmLayer
+	{
+		int32 InputSize = 0;
+		FLstmDirection Directions[2];
+	};
+
+	struct FLinear
+	{
+		int32 InFeatures = 0;
+		int32 OutFeatures = 0;
+
+		// [Out][In]
+		TArray<float> Weights;
+		TArray<float> Bias;
+	};
+
+	FConv1d Convs[NumConvLayers];
+	FLstmLayer LstmLayers[NumLstmLayers];
+	FLinear Classifier;
+	int32 HiddenSize = 0;
+	EQuickDrawPrecision Precision = EQuickDrawPrecision::Float32;
+
+	TArray<FString> Classes;
+	bool bLoaded = false;
+
+	// Leaves the input of the first LSTM layer in Current, OutSeconds gets the time of every layer
+	void RunConvolutions(TConstArrayView<float> Ink, const int32 NumSteps, TArray<float>& Current, TArray<float>& Next,
+		const bool bReferenceKernels, double* OutSeconds) const;
+
+	void RunLstmDirection(const FLstmLayer& Layer, const int32 Direction, const float* In, const int32 NumSteps, float* Out,
+		const bool bReferenceKernels) const;
+
+	// Drawings one after the other in In and Out, longest first
+	void RunLstmDirectionBatch(const FLstmLayer& Layer, const int32 Direction, const float* In, TConstArrayView<int32> NumSteps,
+		TConstArrayView<int32> Offsets, float* Out) const;
+};
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Evaluation/QuickDrawModel.h"
+
+// Live predictions for a painting that keeps growing while it is drawn. The stream keeps the points and every layer's
+// outputs between updates, and the caller only hands over the points after the ones that stay as they are, so an update
+// costs time in proportion to what changed rather than to the drawing. It recomputes from the first input that
+// changed: exactly for the convolutions and the forward LSTM direction, and over at least the last BackwardWindow steps
+// for the backward direction, which restarts from an empty state at the end of the drawing. The normalization box is
+// kept until the drawing moves past it by more than RenormalizeFraction of its size, which recomputes everything.
+// One update at a time, from any thread.
+class SPEEDARTIST_API FQuickDrawStream
+{
+public:
+	explicit FQuickDrawStream(const TSharedRef<const FQuickDrawModel, ESPMode::ThreadSafe>& InModel,
+		const int32 InBackwardWindow = 32, const float InRenormalizeFraction = 0.1f);
+
+	// Keeps the first NumKeptPoints points of the previous update and replaces the rest with NewPoints, rows as
+	// FQuickDrawModel::AppendStrokePoints writes them. Returns false when there is nothing to predict, or nothing changed.
+	bool Update(const int32 NumKeptPoints, TConstArrayView<float> NewPoints, TArray<float>& OutLogits);
+
+	void Reset();
+
+	int32 GetNumPoints() const { return Points.Num() / FQuickDrawModel::InputChannels; }
+
+	// LSTM steps the last update ran, over every layer and direction. A full pass runs 6 per input step.
+	int32 GetLastRecomputedSteps() const { return LastRecomputedSteps; }
+	int32 GetNumSteps() const { return NumSteps; }
+
+private:
+	TSharedRef<const FQuickDrawModel, ESPMode::ThreadSafe> Model;
+	int32 BackwardWindow;
+	float RenormalizeFraction;
+
+	// The points of the previous update
+	TArray<float> Points;
+	int32 NumSteps = 0;
+
+	bool bNormalized = false;
+	float Lower[2] = {};
+	float Upper[2] = {};
+	float Scale[2] = {};
+
+	// Bounding box of the first NumBoxPoints points, which were kept by the previous update
+	int32 NumBoxPoints = 0;
+	float BoxLower[2] = {};
+	float BoxUpper[2] = {};
+
+	// Inputs of every convolution with their zero padding, then the input of the first LSTM layer
+	TArray<float> ConvInputs[FQuickDrawModel::NumConvLayers];
+	TArray<float> LstmInput;
+
+	// Outputs of every LSTM layer, and the cell state after every forward step, to resume from
+	TArray<float> LstmOutputs[FQuickDrawModel::NumLstmLayers];
+	TArray<float> ForwardCells[FQuickDrawModel::NumLstmLayers];
+
+	// Row t sums the rows before t of the last layer's outputs, the classifier input is the last row
+	TArray<float> FeatureSums;
+
+	TArray<float> Gates;
+	TArray<float> Cell;
+	TArray<float> ZeroHidden;
+
+	int32 LastRecomputedSteps = 0;
+
+	// Returns the first step whose input changed, or 0 after renormalizing
+	int32 UpdateInput(const int32 NumKeptPoints, const int32 FirstChangedPoint);
+	void RunLstmLayer(const int32 Layer, const int32 FirstStep, const int32 BackwardStart);
+};
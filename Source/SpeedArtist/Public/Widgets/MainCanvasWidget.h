@@ -29,5 +29,8 @@ public:
 	void StartPrediction();
 	void EndPrediction(const FString& PredictionName);
 	void ResetPrediction();
+
+	// Guesses made while the player is still drawing, best first
+	void ShowLiveGuesses(const TArray<FString>& Guesses);
 	
 };
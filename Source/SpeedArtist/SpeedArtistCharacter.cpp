@@ -66,6 +66,12 @@ void ASpeedArtistCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInp
 
 		// Resetting
 		EnhancedInputComponent->BindAction(ResetAction, ETriggerEvent::Triggered, this, &ASpeedArtistCharacter::ResetInput);
+
+		// Undoing and redoing strokes, optional actions
+		if (UndoAction)
+			EnhancedInputComponent->BindAction(UndoAction, ETriggerEvent::Triggered, this, &ASpeedArtistCharacter::UndoInput);
+		if (RedoAction)
+			EnhancedInputComponent->BindAction(RedoAction, ETriggerEvent::Triggered, this, &ASpeedArtistCharacter::RedoInput);
 		
 		// Drawing
 		EnhancedInputComponent->BindAction(DrawAction, ETriggerEvent::Started, this, &ASpeedArtistCharacter::StartDrawingInput);
@@ -129,3 +135,13 @@ void ASpeedArtistCharacter::ResetInput(const FInputActionValue& Value)
 {
 	// UE_LOG(LogTemp, Display, TEXT("[ASpeedArtistCharacter] Reset!"));
 }
+
+void ASpeedArtistCharacter::UndoInput(const FInputActionValue& Value)
+{
+	// UE_LOG(LogTemp, Display, TEXT("[ASpeedArtistCharacter] Undo!"));
+}
+
+void ASpeedArtistCharacter::RedoInput(const FInputActionValue& Value)
+{
+	// UE_LOG(LogTemp, Display, TEXT("[ASpeedArtistCharacter] Redo!"));
+}
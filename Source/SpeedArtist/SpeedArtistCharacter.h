@@ -48,6 +48,14 @@ class ASpeedArtistCharacter : public ACharacter
 	/** Move Input Action */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Input, meta=(AllowPrivateAccess = "true"))
 	UInputAction* ResetAction;
+
+	/** Undo Input Action */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Input, meta=(AllowPrivateAccess = "true"))
+	UInputAction* UndoAction;
+
+	/** Redo Input Action */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Input, meta=(AllowPrivateAccess = "true"))
+	UInputAction* RedoAction;
 	
 public:
 	ASpeedArtistCharacter();
@@ -83,6 +91,12 @@ protected:
 	/** Called for looking input */
 	virtual void ResetInput(const FInputActionValue& Value);
 
+	/** Called for undo input */
+	virtual void UndoInput(const FInputActionValue& Value);
+
+	/** Called for redo input */
+	virtual void RedoInput(const FInputActionValue& Value);
+
 protected:
 	// APawn interface
 	virtual void SetupPlayerInputComponent(UInputComponent* InputComponent) override;